@@ -7,22 +7,67 @@
  
 #include "application.h"
 #include "audio_manager.h"
+#include "engine_thread.h"
+#include "event_loop.h"
+#include "file_system.h"
 #include "input_manager.h"
+#include "io_scheduler.h"
+#include "latency_profile.h"
+#include "library_index.h"
+#include "library_scanner.h"
+#include "library_watcher.h"
 #include "logger.h"
+#include "memory_arena.h"
+#include "tag_reader.h"
 #include "track.h"
 #include "util.h"
 
 #include <algorithm>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <set>
 #include <unistd.h>
+#include <utility>
 
 #define HAS_ARG(_X) (std::find(_arguments.begin(), _arguments.end(), _X) != _arguments.end())
 
 static const char *__help =
     "DJPi -- Lightweight MP3 player.\n"
-    "Usage: djpi <song directory>\n"
-    "Songs in the current directory will be played if no arguments are provided.";
+    "Usage: djpi [options] <song directory>\n"
+    "Songs in the current directory will be played if no arguments are provided.\n"
+    "Options:\n"
+    "   --update-rate=<hz>  audio update rate (default 50)\n"
+    "   --rt-priority=<n>   real-time priority of the audio thread, 0 to disable (default 10)\n"
+    "   --cpu=<n>           pin the audio thread to a CPU core\n"
+    "   --no-mlock          don't lock memory while the audio thread runs\n"
+    "   --profile=<name>    output latency profile: live, balanced or low-power (default balanced)\n"
+    "   --decode-ahead=<ms> decode tracks ahead into a buffer this deep, 0 to let FMOD stream (default 0)\n"
+    "   --file-io=<mode>    how tracks are read: pread, uring, mmap or fmod (default pread)\n"
+    "   --fmod-memory=<mb>  memory budget for FMOD, 0 to use the system heap (default 64)\n"
+    "   --memory-report=<s> log what each open sound uses this often, 0 to disable (default 0)\n"
+    "   --track-cache=<mb>  memory for keeping recently played tracks open, 0 to disable (default 8)\n"
+    "   --head-cache=<n>    decode the start of this many upcoming tracks ahead, 0 to disable (default 0)\n"
+    "                       tracks started that way can't be seeked or kept in the track cache\n"
+    "   --head-size=<kb>    memory for the start of each upcoming track (default 1024)\n"
+    "   --skip-window=<ms>  time to collect repeated next/previous presses (default 150)\n"
+    "   --seek-index=<dir>  where seek indexes for MP3s are kept (default ~/.djpi/seek)\n"
+    "   --no-seek-index     seek on FMOD's estimate of where VBR frames are\n"
+    "   --scan-threads=<n>  number of threads used to scan directories (default 4)\n"
+    "   --index=<file>      library index location (default ~/.djpi/library.idx)\n"
+    "   --no-index          always scan the full library\n"
+    "   --no-watch          don't pick up files added or removed while running\n"
+    "   --no-tags           list tracks by file name without reading their tags\n"
+    "   --config=<file>     read options from a file, one per line (default ~/.djpi/djpi.conf)\n";
+
+#define DEFAULT_UPDATE_RATE 50
+#define DEFAULT_SKIP_WINDOW 150
+#define DEFAULT_RT_PRIORITY 10
+#define SEEK_STEP_MS        10000
+#define UI_UPDATE_RATE      20
+
+static const char *__no_tracks =
+    "No tracks were found. Provide a path to song files or place song files in the current directory.";
 
 static const char *__header = "=== DJPi ===";
 
@@ -31,7 +76,10 @@ static const char *__controls =
     "   space   =   pause/play\n"
     "   q       =   quit\n"
     "   left/p  =   previous track\n"
-    "   right/n =   next track";
+    "   right/n =   next track\n"
+    "   ,/.     =   seek back/forward 10 seconds\n"
+    "   r       =   toggle repeat\n"
+    "   s       =   status";
 
 namespace djpi {
 
@@ -39,6 +87,20 @@ Application::Application(int argc, char **argv) :
     _start_time(0),
     _audio(new AudioManager),
     _input(new InputManager),
+    _loop(new EventLoop),
+    _update_rate(DEFAULT_UPDATE_RATE),
+    _rt_priority(DEFAULT_RT_PRIORITY),
+    _engine_cpu(-1),
+    _lock_memory(true),
+    _skip_window(DEFAULT_SKIP_WINDOW),
+    _scan_threads(0),
+    _scanned_track_count(0),
+    _scanned_duration_ms(0),
+    _index_filename(LibraryIndex::default_filename()),
+    _watch_library(true),
+    _read_tags(true),
+    _pending_skip(0),
+    _last_skip_time(0.0),
     _kill_loop(false)
 {
     for (unsigned i = 0; i < argc; ++i) {
@@ -62,43 +124,37 @@ void Application::run()
     if (should_exit) {
         return;
     }
+    _audio->set_state_handler([this]() { _loop->wakeup(); });
+    _audio->init();
     
-    if (paths.size() == 0) {
-        Logger::log_error("No tracks were found. Provide a path to song files or place song files in the current directory.");
-        return;
-    }
+    // the audio engine ticks on its own thread, everything else stays on the main loop
+    _engine = std::shared_ptr<EngineThread>(new EngineThread(_audio));
+    _engine->set_update_rate(_update_rate);
+    _engine->set_rt_priority(_rt_priority);
+    _engine->set_cpu(_engine_cpu);
+    _engine->set_lock_memory(_lock_memory);
+    _engine->start();
     
-    // enqueue tracks and start player
-    for (auto path : paths) {
-        _enqueue_tracks(path);
-    }
-    _audio->play();
+    // scan in the background, playback starts as soon as the first track is found
+    _start_scan(paths);
     
-    // begin event loop
-    time_t seconds;
-    while (!_kill_loop) {
-        seconds = time(NULL);
-        _audio->update(seconds);
-        _input->update(seconds);
-        
-        // check if we're done playing everything
-        if (_audio->get_current_track().get() == nullptr && _audio->get_queue_size() == 0) {
-            _kill_loop = true;
-        }
-        
-        // poll key events
-        KeyEvent event;
-        while (_input->poll_event(&event)) {
-            _handle_event(event);
-        }
-        
-        usleep(100);
+    // begin event loop, sleeping until there's input or something to pick up from the scanner
+    _loop->add_fd(_input->get_fd(), [this]() { _process_input(); });
+    _loop->set_tick(UI_UPDATE_RATE, [this]() { _update(); });
+    _loop->set_wakeup_handler([this]() { _update(); }); // scan results and engine state, without waiting for the tick
+    if (!_kill_loop) {
+        _loop->run();
     }
+    
+    // the audio manager belongs to this thread again once the engine has stopped
+    _engine->stop();
+    IoScheduler::shutdown();
 }
 
 void Application::quit()
 {
     _kill_loop = true;
+    _loop->stop();
 }
 
 #pragma mark - Internal
@@ -113,15 +169,146 @@ void Application::_print_header()
     Logger::log(__header);
 }
 
+void Application::_print_status()
+{
+    Logger::log("Event loop: %u wakeups/sec, %u Hz update rate", _loop->get_wakeup_rate(), _loop->get_tick_rate());
+    if (_engine) {
+        Logger::log("Audio engine: %u Hz update rate, %zu late updates, slowest update %.2f ms",
+                    _engine->get_update_rate(), _engine->get_late_update_count(), _engine->get_max_update_time() * 1000.0);
+    }
+    Logger::log("Log: %zu lines dropped", Logger::get_dropped_count());
+    
+    const char *class_names[] = {"playback", "background"};
+    IoScheduler::Class classes[] = {IoScheduler::Class::CRITICAL, IoScheduler::Class::BACKGROUND};
+    for (int i = 0; i < 2; ++i) {
+        IoStats stats = IoScheduler::get_stats(classes[i]);
+        Logger::log("I/O %s: %zu queued, %zu in flight, %zu done, latency p50 %.2f ms, p95 %.2f ms, p99 %.2f ms",
+                    class_names[i], stats.queued, stats.in_flight, stats.completed, stats.latency_p50, stats.latency_p95, stats.latency_p99);
+    }
+    if (IoScheduler::is_throttled()) {
+        Logger::log("I/O: background reads throttled, playback buffer is low");
+    }
+    
+    if (MemoryArena::is_installed()) {
+        MemoryStats memory = MemoryArena::get_stats();
+        Logger::log("FMOD memory: %.1f of %.1f MB used, peak %.1f MB, %zu allocations, %zu failed",
+                    memory.used / 1048576.0, memory.budget / 1048576.0, memory.peak / 1048576.0, memory.allocation_count, memory.failed_count);
+        Logger::log("FMOD memory: %zu free blocks, largest %.1f MB, %.0f%% fragmented",
+                    memory.free_blocks, memory.largest_free / 1048576.0, memory.get_fragmentation() * 100.0);
+        for (auto &type : MemoryArena::get_type_stats()) {
+            if (type.peak > 0) {
+                Logger::log("FMOD memory, %s: %.1f KB in %zu allocations, peak %.1f KB",
+                            type.name, type.current / 1024.0, type.allocation_count, type.peak / 1024.0);
+            }
+        }
+    }
+    _audio->print_status();
+}
+
 bool Application::_parse_args(std::vector<std::string> &paths)
 {
+    _load_config();
+    
     bool should_exit = false;
     if (HAS_ARG("--help")) {
+        Logger::flush();
         std::cerr << __help;
         should_exit = true;
     }
     
     if (!should_exit) {
+        std::string value;
+        if (_get_arg_value("--update-rate", value)) {
+            int rate = atoi(value.c_str());
+            if (rate > 0) {
+                _update_rate = rate;
+            } else {
+                Logger::log_error("Warning: invalid update rate %s, using %d Hz.", value.c_str(), _update_rate);
+            }
+        }
+        
+        if (_get_arg_value("--rt-priority", value)) {
+            _rt_priority = std::max(atoi(value.c_str()), 0);
+        }
+        
+        if (_get_arg_value("--cpu", value)) {
+            _engine_cpu = atoi(value.c_str());
+        }
+        
+        if (HAS_ARG("--no-mlock")) {
+            _lock_memory = false;
+        }
+        
+        if (_get_arg_value("--profile", value)) {
+            const LatencyProfile *profile = LatencyProfile::find(value);
+            if (profile) {
+                _audio->set_latency_profile(*profile);
+            } else {
+                Logger::log_error("Warning: unknown profile %s, expected one of %s.", value.c_str(), LatencyProfile::get_names().c_str());
+            }
+        }
+        
+        if (_get_arg_value("--decode-ahead", value)) {
+            _audio->set_decode_ahead(std::max(atoi(value.c_str()), 0));
+        }
+        
+        if (_get_arg_value("--file-io", value)) {
+            FileSystem::Mode mode;
+            if (FileSystem::parse_mode(value, mode)) {
+                _audio->set_file_io(mode);
+            } else {
+                Logger::log_error("Warning: unknown file I/O mode %s.", value.c_str());
+            }
+        }
+        
+        if (_get_arg_value("--fmod-memory", value)) {
+            _audio->set_memory_budget((size_t) std::max(atoi(value.c_str()), 0) * 1024 * 1024);
+        }
+        
+        if (_get_arg_value("--memory-report", value)) {
+            _audio->set_memory_report_interval(std::max(atoi(value.c_str()), 0));
+        }
+        
+        if (_get_arg_value("--track-cache", value)) {
+            _audio->set_track_cache_budget((size_t) std::max(atoi(value.c_str()), 0) * 1024 * 1024);
+        }
+        
+        if (_get_arg_value("--head-cache", value)) {
+            _audio->set_head_cache_window(std::max(atoi(value.c_str()), 0));
+        }
+        
+        if (_get_arg_value("--head-size", value)) {
+            _audio->set_head_size((size_t) std::max(atoi(value.c_str()), 0) * 1024);
+        }
+        
+        if (_get_arg_value("--skip-window", value)) {
+            _skip_window = atoi(value.c_str());
+        }
+        
+        if (HAS_ARG("--no-seek-index")) {
+            _audio->set_seek_index_directory("");
+        } else if (_get_arg_value("--seek-index", value)) {
+            _audio->set_seek_index_directory(value);
+        }
+        
+        if (_get_arg_value("--scan-threads", value)) {
+            _scan_threads = std::max(atoi(value.c_str()), 0);
+        }
+        
+        if (HAS_ARG("--no-index")) {
+            _index_filename.clear();
+        } else if (_get_arg_value("--index", value)) {
+            _index_filename = value;
+        }
+        
+        if (HAS_ARG("--no-watch")) {
+            _watch_library = false;
+        }
+        
+        if (HAS_ARG("--no-tags")) {
+            _read_tags = false;
+        }
+        
         for (auto itr = _arguments.begin() + 1; itr != _arguments.end(); ++itr) {
             std::string arg = *itr;
             if (arg[0] != '-') {
@@ -139,6 +326,79 @@ bool Application::_parse_args(std::vector<std::string> &paths)
     return should_exit;
 }
 
+void Application::_load_config()
+{
+    std::string filename;
+    if (!_get_arg_value("--config", filename)) {
+        const char *home = getenv("HOME");
+        if (!home) {
+            return;
+        }
+        filename = std::string(home) + "/.djpi/djpi.conf";
+    }
+    
+    std::ifstream file(filename);
+    if (!file.is_open()) {
+        return;
+    }
+    
+    // "name = value" or a bare "name" per line, read as --name=value or --name. these go after
+    // the command line so anything given there wins.
+    std::string line;
+    while (std::getline(file, line)) {
+        line = line.substr(0, line.find('#'));
+        size_t equals = line.find('=');
+        std::string name = Util::trim(line.substr(0, equals));
+        if (name.empty()) {
+            continue;
+        }
+        
+        std::string arg = "--" + name;
+        if (equals != std::string::npos) {
+            arg += "=" + Util::trim(line.substr(equals + 1));
+        }
+        _arguments.push_back(arg);
+    }
+}
+
+bool Application::_get_arg_value(std::string name, std::string &value)
+{
+    std::string prefix = name + "=";
+    for (auto arg : _arguments) {
+        if (arg.compare(0, prefix.size(), prefix) == 0) {
+            value = arg.substr(prefix.size());
+            return true;
+        }
+    }
+    return false;
+}
+
+void Application::_update()
+{
+    _update_scan();
+    _update_watcher();
+    _apply_pending_skip();
+    
+    // check if we're done playing everything
+    if (!_scanner && _audio->is_idle()) {
+        quit();
+    }
+}
+
+void Application::_process_input()
+{
+    if (!_input->update(time(NULL))) {
+        // stdin stays readable at end of file, keep playing without it
+        Logger::log_debug("Input closed.");
+        _loop->remove_fd(_input->get_fd());
+    }
+    
+    KeyEvent event;
+    while (_input->poll_event(&event)) {
+        _handle_event(event);
+    }
+}
+
 void Application::_handle_event(const KeyEvent &e)
 {
     switch (e.key) {
@@ -146,54 +406,161 @@ void Application::_handle_event(const KeyEvent &e)
             quit();
             break;
         case 0x20: // space
-            if (_audio->is_playing()) {
-                _audio->pause();
-            } else {
-                _audio->play();
-            }
+            _audio->toggle_pause();
             break;
         case 0x43: // right arrow
         case 'n':
-            _audio->next_track();
+            _queue_skip(1);
             break;
         case 0x44: // left arrow
         case 'p':
-            _audio->previous_track();
+            _queue_skip(-1);
+            break;
+        case ',':
+            _audio->seek(-SEEK_STEP_MS);
+            break;
+        case '.':
+            _audio->seek(SEEK_STEP_MS);
+            break;
+        case 'r':
+            _audio->toggle_repeat();
+            break;
+        case 's':
+            _print_status();
             break;
         default:
             break;
     }
 }
 
-void Application::_enqueue_tracks(std::string path)
+void Application::_queue_skip(int offset)
+{
+    // collapse bursts of next/previous into a single jump so only the destination track gets opened
+    _pending_skip += offset;
+    _last_skip_time = Util::current_time();
+}
+
+void Application::_apply_pending_skip()
+{
+    if (_pending_skip != 0 && (Util::current_time() - _last_skip_time) * 1000.0 >= _skip_window) {
+        _audio->skip_tracks(_pending_skip);
+        _pending_skip = 0;
+    }
+}
+
+void Application::_start_scan(const std::vector<std::string> &paths)
+{
+    _scanner = std::shared_ptr<LibraryScanner>(new LibraryScanner(_scan_threads));
+    
+    // directories that haven't changed since the last run are listed straight from the index
+    if (!_index_filename.empty()) {
+        std::shared_ptr<LibraryIndex> index(new LibraryIndex);
+        if (index->open(_index_filename)) {
+            _scanner->set_index(index);
+        }
+    }
+    _scanner->set_collect_directories(!_index_filename.empty() || _watch_library);
+    _scanner->set_read_tags(_read_tags);
+    _scanner->set_result_handler([this]() { _loop->wakeup(); });
+    
+    _scanner->start(paths);
+}
+
+void Application::_update_scan()
 {
+    if (!_scanner) {
+        return;
+    }
+    
+    // check before draining so the last batch can't slip in between
+    bool finished = _scanner->is_finished();
+    
     std::vector<std::string> track_filenames;
+    std::vector<TrackInfo> track_infos;
+    if (_scanner->poll_results(track_filenames, track_infos)) {
+        // sorted by filename, keeping each track's info with it
+        std::vector<size_t> order(track_filenames.size());
+        for (size_t i = 0; i < order.size(); ++i) {
+            order[i] = i;
+        }
+        std::sort(order.begin(), order.end(), [&track_filenames](size_t a, size_t b) {
+            return track_filenames[a] < track_filenames[b];
+        });
+        
+        std::vector<std::string> sorted_filenames;
+        std::vector<TrackInfo> sorted_infos;
+        sorted_filenames.reserve(order.size());
+        sorted_infos.reserve(order.size());
+        for (size_t i : order) {
+            Logger::log("\t%s", TagReader::describe(track_infos[i], Util::basename(track_filenames[i]).c_str()).c_str());
+            _scanned_duration_ms += track_infos[i].duration_ms;
+            sorted_filenames.push_back(std::move(track_filenames[i]));
+            sorted_infos.push_back(std::move(track_infos[i]));
+        }
+        
+        // playback starts as soon as the first batch lands
+        _scanned_track_count += sorted_filenames.size();
+        _audio->enqueue_tracks(std::move(sorted_filenames), std::move(sorted_infos));
+    }
     
-    if (Util::is_directory(path)) {
-        std::vector<std::string> dir_contents = Util::list_directory(path);
-        for (auto filename : dir_contents) {
-            if (!Util::is_directory(path + "/" + filename)) {
-                if (AudioManager::supports_filename(filename)) {
-                    track_filenames.push_back(filename);
-                } else {
-                    Logger::log_error("Warning: %s is an unsupported file type.", filename.c_str());
-                }
-            }
+    if (finished) {
+        size_t unsupported_count = _scanner->get_unsupported_count();
+        if (unsupported_count > 0) {
+            Logger::log_error("Warning: skipped %zu files of unsupported types.", unsupported_count);
+        }
+        
+        size_t directory_count = _scanner->get_directory_count();
+        size_t cached_count = _scanner->get_cached_directory_count();
+        unsigned long long minutes = (_scanned_duration_ms + 30000) / 60000;
+        Logger::log("Playlist (%zu total tracks in %zu directories, %llu:%02llu hours, %zu unchanged since last run).",
+                    _scanned_track_count, directory_count, minutes / 60, minutes % 60, cached_count);
+        if (_scanned_track_count == 0) {
+            Logger::log_error(__no_tracks);
         }
-    } else if (AudioManager::supports_filename(path)) {
-        track_filenames.push_back(Util::basename(path));
-        path = Util::dirname(path);
-    } else {
-        Logger::log_error("Warning: %s is an unsupported file type.", path.c_str());
+        
+        std::vector<LibraryDirectory> directories = _scanner->take_directories();
+        if (!_index_filename.empty() && cached_count < directory_count) {
+            LibraryIndex::write(_index_filename, directories);
+        }
+        if (_watch_library) {
+            _start_watching(directories);
+        }
+        
+        _scanner = nullptr;
+    }
+}
+
+void Application::_start_watching(const std::vector<LibraryDirectory> &directories)
+{
+    _watcher = std::shared_ptr<LibraryWatcher>(new LibraryWatcher(_read_tags));
+    if (!_watcher->is_available()) {
+        _watcher = nullptr;
+        return;
     }
+    _watcher->set_change_handler([this]() { _loop->wakeup(); });
     
-    Logger::log("Playlist (%d total tracks):", track_filenames.size());
-    for (auto track_filename : track_filenames) {
-        Logger::log("\t%s", track_filename.c_str());
-        std::string abspath = path + "/" + track_filename;
-        TrackRef track(new Track(abspath));
-        _audio->enqueue_track(track);
+    for (auto &directory : directories) {
+        _watcher->watch_directory(directory.path);
+    }
+    
+    // the descriptor only becomes readable when something changes, so this costs nothing while idle
+    _loop->add_fd(_watcher->get_fd(), [this]() { _watcher->read_events(); });
+    Logger::log("Watching %zu directories for changes.", _watcher->get_watch_count());
+}
+
+void Application::_update_watcher()
+{
+    if (!_watcher) {
+        return;
+    }
+    
+    std::vector<std::string> added_filenames;
+    std::vector<TrackInfo> added_infos;
+    std::set<std::string> removed_paths;
+    if (!_watcher->poll_changes(added_filenames, added_infos, removed_paths)) {
+        return;
     }
+    _audio->update_library(std::move(added_filenames), std::move(added_infos), std::move(removed_paths));
 }
 
 } // namespace djpi
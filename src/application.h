@@ -15,7 +15,12 @@
 namespace djpi {
 
 class AudioManager;
+class EngineThread;
+class EventLoop;
 class InputManager;
+class LibraryScanner;
+class LibraryWatcher;
+struct LibraryDirectory;
 struct KeyEvent;
 
 class Application {
@@ -30,19 +35,46 @@ public:
     // running
     void run();
     void quit();
-    
+
 private:
     void _print_header();
     void _print_controls();
+    void _print_status();
     bool _parse_args(std::vector<std::string> &paths);
+    void _load_config();
+    bool _get_arg_value(std::string name, std::string &value);
+    void _update();
+    void _process_input();
     void _handle_event(const KeyEvent &e);
-    void _enqueue_tracks(std::string path);
-    
+    void _queue_skip(int offset);
+    void _apply_pending_skip();
+    void _start_scan(const std::vector<std::string> &paths);
+    void _update_scan();
+    void _start_watching(const std::vector<LibraryDirectory> &directories);
+    void _update_watcher();
+
 protected:
     std::vector<std::string> _arguments;
     time_t _start_time;
     std::shared_ptr<AudioManager> _audio;
     std::shared_ptr<InputManager> _input;
+    std::shared_ptr<EngineThread> _engine;
+    std::shared_ptr<EventLoop> _loop;
+    std::shared_ptr<LibraryScanner> _scanner;
+    std::shared_ptr<LibraryWatcher> _watcher;
+    unsigned _update_rate;
+    int _rt_priority;
+    int _engine_cpu;
+    bool _lock_memory;
+    int _skip_window;
+    unsigned _scan_threads;
+    size_t _scanned_track_count;
+    unsigned long long _scanned_duration_ms; // of the tracks that had one
+    std::string _index_filename;
+    bool _watch_library;
+    bool _read_tags;
+    int _pending_skip;
+    double _last_skip_time;
     bool _kill_loop;
 };
 
@@ -6,150 +6,627 @@
  */
  
 #include "audio_manager.h"
+#include "io_scheduler.h"
 #include "logger.h"
+#include "memory_arena.h"
+#include "tag_reader.h"
 #include "util.h"
 
 #include <algorithm>
 #include <iostream>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
 #include <fmod/fmod_errors.h>
-#include <set>
+#include <fmod/fmod_memoryinfo.h>
 #include <string>
+#include <utility>
 
-#define MAX_CHANNELS    100
+#define MAX_CHANNELS            100
+#define SCHEDULE_LOOKAHEAD_MS   2000
+#define COMMAND_QUEUE_SIZE      256
+#define DEFAULT_FILE_IO         FileSystem::Mode::PREAD
+#define DEFAULT_MEMORY_BUDGET   (64 * 1024 * 1024)
+#define DEFAULT_TRACK_CACHE     (8 * 1024 * 1024)
+#define DEFAULT_HEAD_SIZE       (1024 * 1024)
+#define HEAD_STREAM_BUFFER_MS   1000 // ring behind a head when we aren't otherwise decoding ahead
+#define END_CLOCK_TOLERANCE_MS  100  // how far a decoded track's end can drift before it's rescheduled
 
 static FMOD_RESULT F_CALLBACK __channel_callback(FMOD_CHANNEL *channel,
                                                  FMOD_CHANNEL_CALLBACKTYPE type,
                                                  void *commanddata1,
                                                  void *commanddata2);
 
+static bool __contains_path(const std::set<std::string> &paths, const std::string &filename)
+{
+    // matches the file itself or any of the directories above it
+    std::string path = filename;
+    while (!path.empty()) {
+        if (paths.count(path) > 0) {
+            return true;
+        }
+        
+        size_t slash = path.find_last_of('/');
+        if (slash == std::string::npos || slash == 0) {
+            break;
+        }
+        path.resize(slash);
+    }
+    return false;
+}
+
+static size_t __get_memory_available()
+{
+    // a sample needs its memory in one piece. without the arena FMOD can have whatever the system has.
+    if (!djpi::MemoryArena::is_installed()) {
+        return SIZE_MAX;
+    }
+    return djpi::MemoryArena::get_stats().largest_free;
+}
+
+static std::string __describe_memory(const FMOD_MEMORY_USAGE_DETAILS &details)
+{
+    const struct {
+        const char *name;
+        unsigned int bytes;
+    } categories[] = {
+        {"stream buffer", details.streambuffer},
+        {"codec", details.codec},
+        {"file", details.file},
+        {"sound", details.sound},
+        {"dsp codec", details.dspcodec},
+        {"dsp", details.dsp},
+        {"channel", details.channel},
+        {"system", details.system},
+        {"output", details.output},
+        {"plugins", details.plugins},
+        {"sync points", details.syncpoint},
+        {"strings", details.string},
+        {"other", details.other}
+    };
+    
+    std::string description;
+    for (auto &category : categories) {
+        if (category.bytes > 0) {
+            char buffer[64];
+            snprintf(buffer, sizeof(buffer), "%s%s %.1f KB", (description.empty() ? "" : ", "), category.name, category.bytes / 1024.0);
+            description += buffer;
+        }
+    }
+    return description;
+}
+
+static std::string __describe_track(const djpi::TrackTable &table, djpi::TrackHandle handle)
+{
+    return djpi::TagReader::describe(table.get_info(handle), table.get_name(handle));
+}
+
 namespace djpi {
 
 AudioManager::AudioManager() :
     _audio_system(nullptr),
     _channel(nullptr),
-    _current_track(nullptr),
-    _playing(false)
+    _playing(false),
+    _play_pending(false),
+    _head_window(0),
+    _head_size(DEFAULT_HEAD_SIZE),
+    _head_window_cursor(Playlist::npos),
+    _head_window_playlist_size(0),
+    _seek_index_directory(SeekIndexer::default_directory()),
+    _track_cpu_total(0.0),
+    _track_cpu_samples(0),
+    _profile(LatencyProfile::get_default()),
+    _decode_ahead_ms(0),
+    _file_io(DEFAULT_FILE_IO),
+    _memory_budget(DEFAULT_MEMORY_BUDGET),
+    _memory_report_interval(0),
+    _last_memory_report(0),
+    _output_rate(0),
+    _prefetched_index(Playlist::npos),
+    _scheduled_channel(nullptr),
+    _current_end_clock(0),
+    _pause_clock(0),
+    _pending_seek(TrackTable::invalid_handle),
+    _commands(COMMAND_QUEUE_SIZE),
+    _posted_count(0),
+    _processed_count(0),
+    _idle(true)
 {
+    _track_cache.set_budget(DEFAULT_TRACK_CACHE);
+}
+
+AudioManager::~AudioManager()
+{
+    // release all of our streams first
+    _clear_track_queue();
+    _complete_current_track();
+    _release_retired_streams(true);
+    _track_cache.clear();
+    _loaded_tracks.clear();
+    _playlist.clear();
+    
+    // closed decoders may still be reading through the system
+    _head_cache = nullptr;
+    PCMStream::wait_for_decoders();
+    
+    if (_audio_system) {
+        _audio_system->release();
+        _audio_system = nullptr;
+    }
+}
+
+#pragma mark - Configuration
+
+void AudioManager::init()
+{
+    // FMOD's allocator has to be in place before it creates anything
+    if (_memory_budget > 0) {
+        MemoryArena::install(_memory_budget);
+    }
+    
     FMOD_RESULT result = FMOD::System_Create(&_audio_system);
     if (result != FMOD_OK) {
         _print_error(result);
         exit(-1);
     }
     
+    // the mixer format and buffers can only be set before the system is initialized
+    _audio_system->setSoftwareFormat(_profile.sample_rate, FMOD_SOUND_FORMAT_PCM16, 2, 0, _profile.resampler);
+    _audio_system->setDSPBufferSize(_profile.dsp_buffer_length, _profile.dsp_buffer_count);
+    _audio_system->setSoftwareChannels(_profile.software_channels);
+    _audio_system->setSpeakerMode(FMOD_SPEAKERMODE_STEREO);
+    FileSystem::install(_audio_system, _file_io);
+    
     result = _audio_system->init(MAX_CHANNELS, FMOD_INIT_NORMAL, NULL);
     if (result != FMOD_OK) {
         _print_error(result);
         exit(-1);
     }
+    _audio_system->setStreamBufferSize(_profile.stream_buffer_size, FMOD_TIMEUNIT_RAWBYTES);
     
-    _audio_system->setSpeakerMode(FMOD_SPEAKERMODE_STEREO);
+    if (_head_window > 0 && _head_size > 0) {
+        _head_cache = std::shared_ptr<HeadCache>(new HeadCache(_audio_system, _head_size));
+        
+        // a track started from its head plays from our own decoder's ring for the rest of
+        // the track, which can't be rewound, so it loses seeking and the track cache
+        Logger::log("Head cache: on for %zu tracks, tracks started from a head can't be seeked or kept in the track cache.",
+                    _head_window);
+    }
+    if (!_seek_index_directory.empty()) {
+        _seek_indexer = std::shared_ptr<SeekIndexer>(new SeekIndexer(_seek_index_directory));
+    }
+    
+    // report what the output actually gave us, it's free to round the requested sizes
+    unsigned int buffer_length = 0;
+    int buffer_count = 0;
+    _audio_system->getDSPBufferSize(&buffer_length, &buffer_count);
+    _audio_system->getSoftwareFormat(&_output_rate, NULL, NULL, NULL, NULL, NULL);
+    
+    LatencyProfile actual = _profile;
+    actual.sample_rate = _output_rate;
+    actual.dsp_buffer_length = buffer_length;
+    actual.dsp_buffer_count = buffer_count;
+    Logger::log("Audio output: %s profile, %d Hz, %d x %u sample buffers, %.1f ms latency.",
+                _profile.name, _output_rate, buffer_count, buffer_length, actual.get_output_latency());
 }
 
-AudioManager::~AudioManager()
+#pragma mark - Controlling Playback
+
+bool AudioManager::post(Command command)
 {
-    // release all of our streams first
-    clear_track_queue();
-    _current_track = nullptr;
+    _posted_count.fetch_add(1);
+    if (!_commands.push(std::move(command))) {
+        _posted_count.fetch_sub(1);
+        Logger::log_error("Audio command queue is full, dropping command.");
+        return false;
+    }
+    return true;
+}
+
+void AudioManager::play()
+{
+    post(Command(Command::Type::PLAY));
+}
+
+void AudioManager::pause()
+{
+    post(Command(Command::Type::PAUSE));
+}
+
+void AudioManager::toggle_pause()
+{
+    post(Command(Command::Type::TOGGLE_PAUSE));
+}
+
+void AudioManager::stop()
+{
+    post(Command(Command::Type::STOP));
+}
+
+void AudioManager::skip_tracks(int offset)
+{
+    post(Command(Command::Type::SKIP, offset));
+}
+
+void AudioManager::seek(int offset_ms)
+{
+    post(Command(Command::Type::SEEK, offset_ms));
+}
+
+void AudioManager::jump_to_track(size_t index)
+{
+    post(Command(Command::Type::JUMP, (long) index));
+}
+
+void AudioManager::set_repeat(bool repeat)
+{
+    post(Command(Command::Type::SET_REPEAT, repeat));
+}
+
+void AudioManager::toggle_repeat()
+{
+    post(Command(Command::Type::TOGGLE_REPEAT));
+}
+
+void AudioManager::set_volume(float vol)
+{
+    Command command(Command::Type::SET_VOLUME);
+    command.volume = vol;
+    post(command);
+}
+
+void AudioManager::enqueue_tracks(std::vector<std::string> filenames, std::vector<TrackInfo> infos)
+{
+    Command command(Command::Type::ENQUEUE_TRACKS);
+    command.filenames = std::shared_ptr<std::vector<std::string>>(new std::vector<std::string>);
+    command.filenames->swap(filenames);
+    command.infos = std::shared_ptr<std::vector<TrackInfo>>(new std::vector<TrackInfo>);
+    command.infos->swap(infos);
+    post(command);
+}
+
+void AudioManager::update_library(std::vector<std::string> added, std::vector<TrackInfo> added_infos, std::set<std::string> removed)
+{
+    Command command(Command::Type::UPDATE_LIBRARY);
+    command.filenames = std::shared_ptr<std::vector<std::string>>(new std::vector<std::string>);
+    command.filenames->swap(added);
+    command.infos = std::shared_ptr<std::vector<TrackInfo>>(new std::vector<TrackInfo>);
+    command.infos->swap(added_infos);
+    command.paths = std::shared_ptr<std::set<std::string>>(new std::set<std::string>);
+    command.paths->swap(removed);
+    post(command);
+}
+
+void AudioManager::print_status()
+{
+    post(Command(Command::Type::PRINT_STATUS));
+}
+
+bool AudioManager::is_idle() const
+{
+    // only trust the snapshot once every command posted so far has been applied to it
+    return _idle.load() && _processed_count.load() == _posted_count.load();
+}
+
+#pragma mark - Updating
+
+void AudioManager::update(time_t time)
+{
+    // FMOD fires channel callbacks from inside update(), their commands are handled right after
+    _audio_system->update();
+    size_t processed_count = _process_commands();
     
-    if (_channel) {
-        _channel->stop();
-        _channel = nullptr;
+    _release_retired_streams(false);
+    _prune_tracks();
+    _start_pending_track();
+    _check_decoder();
+    _check_pending_seek();
+    _prefetch_next_track();
+    _update_io_priority();
+    _update_head_window();
+    _sample_cpu_usage();
+    
+    if (_memory_report_interval > 0 && time - _last_memory_report >= _memory_report_interval) {
+        _print_memory_usage();
+        _last_memory_report = time;
     }
     
-    if (_audio_system) {
-        _audio_system->release();
-        _audio_system = nullptr;
+    bool idle = (_playlist.get_cursor() == Playlist::npos && _playlist.get_upcoming_count() == 0);
+    bool was_idle = _idle.exchange(idle);
+    if (processed_count > 0) {
+        _processed_count.fetch_add(processed_count);
+    }
+    if ((processed_count > 0 || idle != was_idle) && _state_handler) {
+        _state_handler();
+    }
+}
+
+#pragma mark - Callbacks
+
+void AudioManager::track_completion_callback(FMOD::Channel *channel)
+{
+    Command command(Command::Type::TRACK_ENDED);
+    command.channel = channel;
+    post(command);
+}
+
+#pragma mark - Commands
+
+size_t AudioManager::_process_commands()
+{
+    size_t count = 0;
+    Command command;
+    while (_commands.pop(command)) {
+        _handle_command(command);
+        ++count;
+    }
+    return count;
+}
+
+void AudioManager::_handle_command(const Command &command)
+{
+    switch (command.type) {
+        case Command::Type::PLAY:
+            _play();
+            break;
+        case Command::Type::PAUSE:
+            _pause();
+            break;
+        case Command::Type::TOGGLE_PAUSE:
+            if (_playing) {
+                _pause();
+            } else {
+                _play();
+            }
+            break;
+        case Command::Type::STOP:
+            _stop();
+            break;
+        case Command::Type::SKIP:
+            _skip_tracks((int) command.value);
+            break;
+        case Command::Type::SEEK:
+            _seek(command.value);
+            break;
+        case Command::Type::JUMP:
+            _jump_to_track((size_t) command.value);
+            break;
+        case Command::Type::SET_REPEAT:
+            _set_repeat(command.value != 0);
+            break;
+        case Command::Type::TOGGLE_REPEAT:
+            _set_repeat(!_playlist.get_repeat());
+            break;
+        case Command::Type::SET_VOLUME:
+            _set_volume(command.volume);
+            break;
+        case Command::Type::ENQUEUE_TRACKS:
+            _enqueue_tracks(*command.filenames, *command.infos);
+            break;
+        case Command::Type::UPDATE_LIBRARY:
+            _update_library(*command.filenames, *command.infos, *command.paths);
+            break;
+        case Command::Type::TRACK_ENDED:
+            _handle_track_end(command.channel);
+            break;
+        case Command::Type::PRINT_STATUS:
+            _print_status();
+            break;
+    }
+}
+
+void AudioManager::_print_status()
+{
+    size_t index = _playlist.get_cursor();
+    Track *track = (index != Playlist::npos ? _find_track(_playlist.at(index)) : nullptr);
+    if (track && track->_pcm_stream) {
+        const PCMStream &stream = *track->_pcm_stream;
+        Logger::log("Decode ahead: %.0f%% full, lowest %.0f%%, %zu underruns", stream.get_fill_level() * 100.f,
+                    stream.get_lowest_fill_level() * 100.f, stream.get_underrun_count());
+    } else if (_decode_ahead_ms > 0) {
+        Logger::log("Decode ahead: not in use for the current track");
+    }
+    
+    if (track && track->_file_stats) {
+        Logger::log("File reads: %.1f MB in %zu reads for the current track",
+                    track->_file_stats->bytes_read.load() / (1024.0 * 1024.0), track->_file_stats->read_count.load());
+    }
+    
+    TrackCacheStats cache = _track_cache.get_stats();
+    Logger::log("Track cache: %zu tracks, %.1f of %.1f MB, %zu hits, %zu misses, %zu evictions", cache.track_count,
+                cache.bytes / (1024.0 * 1024.0), cache.budget / (1024.0 * 1024.0), cache.hits, cache.misses, cache.evictions);
+    
+    LoadMode modes[] = {LoadMode::STREAM, LoadMode::SAMPLE, LoadMode::COMPRESSED_SAMPLE};
+    for (LoadMode mode : modes) {
+        LoadModeStats loads = _load_policy.get_stats(mode);
+        if (loads.opened > 0 || loads.played > 0) {
+            Logger::log("Loaded as %s: %zu opened, %.1f ms average, %.1f ms slowest, %.1f%% CPU while playing",
+                        LoadPolicy::get_mode_name(mode), loads.opened, loads.average_open_time, loads.slowest_open_time, loads.average_cpu);
+        }
+    }
+    
+    if (_head_cache) {
+        HeadCacheStats heads = _head_cache->get_stats();
+        Logger::log("Head cache: %zu tracks, %.1f MB, %zu hits, %zu misses", heads.head_count,
+                    heads.bytes / (1024.0 * 1024.0), heads.hits, heads.misses);
+    }
+    
+    _print_memory_usage();
+}
+
+void AudioManager::_print_memory_usage()
+{
+    unsigned int used = 0;
+    FMOD_MEMORY_USAGE_DETAILS details;
+    if (_audio_system->getMemoryInfo(FMOD_MEMBITS_ALL, 0, &used, &details) == FMOD_OK) {
+        Logger::log("Memory, FMOD total: %.1f KB (%s)", used / 1024.0, __describe_memory(details).c_str());
+    }
+    
+    // every sound we hold open, so formats and load modes can be compared side by side
+    size_t current = _playlist.get_cursor();
+    TrackHandle current_handle = (current != Playlist::npos ? _playlist.at(current) : TrackTable::invalid_handle);
+    TrackHandle next_handle = (_prefetched_index != Playlist::npos ? _playlist.at(_prefetched_index) : TrackTable::invalid_handle);
+    const TrackTable &table = _playlist.get_table();
+    for (auto &track : _loaded_tracks) {
+        if (!track._stream || track._stream->getMemoryInfo(FMOD_MEMBITS_ALL, 0, &used, &details) != FMOD_OK) {
+            continue;
+        }
+        
+        const char *role = (track._handle == current_handle ? "current" : (track._handle == next_handle ? "next" : "open"));
+        Logger::log("Memory, %s track %s: %.1f KB (%s)", role, Util::basename(table.get_filename(track._handle)).c_str(),
+                    used / 1024.0, __describe_memory(details).c_str());
+    }
+    
+    // recently played tracks are still open sounds too, they're just not in the playlist window
+    for (const Track *track : _track_cache.get_tracks()) {
+        if (!track->_stream || track->_stream->getMemoryInfo(FMOD_MEMBITS_ALL, 0, &used, &details) != FMOD_OK) {
+            continue;
+        }
+        Logger::log("Memory, cached track %s: %.1f KB (%s)", Util::basename(table.get_filename(track->_handle)).c_str(),
+                    used / 1024.0, __describe_memory(details).c_str());
+    }
+    
+    unsigned int retired_used = 0;
+    for (FMOD::Sound *stream : _retired_streams) {
+        if (stream->getMemoryInfo(FMOD_MEMBITS_ALL, 0, &used, &details) == FMOD_OK) {
+            retired_used += used;
+        }
+    }
+    if (_retired_streams.size() > 0) {
+        Logger::log("Memory, %zu streams waiting to be released: %.1f KB", _retired_streams.size(), retired_used / 1024.0);
     }
 }
 
 #pragma mark - Managing Tracks
 
-void AudioManager::enqueue_track(TrackRef track)
+void AudioManager::_enqueue_tracks(const std::vector<std::string> &filenames, const std::vector<TrackInfo> &infos)
+{
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        _playlist.append(filenames[i], (i < infos.size() ? infos[i] : TrackInfo()));
+    }
+    
+    // start with whatever turned up first, the rest of the library keeps streaming in behind it.
+    // this also picks playback back up if we ran out of tracks before the scan caught up.
+    if (filenames.size() > 0 && _playlist.get_cursor() == Playlist::npos) {
+        _play();
+    }
+}
+
+void AudioManager::_update_library(const std::vector<std::string> &added, const std::vector<TrackInfo> &added_infos, const std::set<std::string> &removed)
 {
-    _track_queue.push_back(track);
+    size_t removed_count = _remove_tracks(removed);
+    size_t added_count = 0;
+    for (size_t i = 0; i < added.size(); ++i) {
+        // files that were rewritten in place are already in the playlist
+        if (!_playlist.contains(added[i])) {
+            _playlist.append(added[i], (i < added_infos.size() ? added_infos[i] : TrackInfo()));
+            ++added_count;
+        }
+    }
+    
+    if (added_count > 0 || removed_count > 0) {
+        Logger::log("Library changed: %zu tracks added, %zu removed (%zu total).", added_count, removed_count, _playlist.size());
+        if (added_count > 0 && _playlist.get_cursor() == Playlist::npos) {
+            _play();
+        }
+    }
 }
 
-void AudioManager::clear_track_queue()
+void AudioManager::_clear_track_queue()
 {
-    _track_queue.clear();
+    _release_prefetched_track();
+    _playlist.clear_upcoming();
 }
 
-size_t AudioManager::get_queue_size()
+size_t AudioManager::_remove_tracks(const std::set<std::string> &paths)
 {
-    return _track_queue.size();
+    if (paths.empty()) {
+        return 0;
+    }
+    
+    // whatever is lined up next is released properly rather than destroyed with the track
+    const TrackTable &table = _playlist.get_table();
+    if (_prefetched_index != Playlist::npos && __contains_path(paths, table.get_filename(_playlist.at(_prefetched_index)))) {
+        _release_prefetched_track();
+    }
+    
+    // the playing track is left alone, it stays in the history once it finishes
+    size_t current = _playlist.get_cursor();
+    size_t prefetched_shift = 0;
+    size_t removed = _playlist.remove_tracks([&](size_t index, TrackHandle handle) {
+        if (index == current || !__contains_path(paths, table.get_filename(handle))) {
+            return false;
+        }
+        
+        Track *track = _find_track(handle);
+        if (track) {
+            _retire_stream(*track);
+        }
+        _track_cache.remove(handle);
+        if (index < _prefetched_index) {
+            ++prefetched_shift;
+        }
+        return true;
+    });
+    
+    if (_prefetched_index != Playlist::npos) {
+        _prefetched_index -= prefetched_shift;
+    }
+    return removed;
 }
 
-#pragma mark - Controlling Playback
+#pragma mark - Playback
 
-void AudioManager::play()
+void AudioManager::_play()
 {
     if (_channel) {
+        if (!_playing) {
+            // push the expected end of the track back by however long we were paused
+            _current_end_clock += _get_dsp_clock() - _pause_clock;
+        }
         _channel->setPaused(false);
         _playing = true;
     } else {
-        TrackRef track = _current_track;
-        if (!track.get()) {
-            track = _dequeue_track();
+        if (_playlist.get_cursor() == Playlist::npos) {
+            _playlist.advance();
         }
         
-        if (track.get()) {
-            FMOD::Sound *sound = track->_stream;
-            if (!sound) {
-                _load_track(track);
-                sound = track->_stream;
-            }
-            
-            FMOD::Channel *channel;
-            FMOD_RESULT result = _audio_system->playSound(FMOD_CHANNEL_FREE, sound, false, &channel);
-            if (result == FMOD_OK) {
-                // configure the channel
-                channel->setUserData(this);
-                channel->setCallback(__channel_callback);
-                
-                // store related memory
-                _playing = true;
-                _current_track = track;
-                _channel = channel;
-                
-                // log current track
-                std::string track_filename = Util::basename(track->get_filename());
-                Logger::log("Playing track %s...", track_filename.c_str());
-            }
+        size_t index = _playlist.get_cursor();
+        if (index != Playlist::npos) {
+            // start opening the track, playback begins from update() once it's ready
+            _load_track(_get_track(index), true);
+            _play_pending = true;
+            _start_pending_track();
         } else {
             Logger::log_error("No more tracks in queue.");
         }
     }
 }
 
-void AudioManager::pause()
+void AudioManager::_pause()
 {
-    if (_channel) {
+    _play_pending = false;
+    
+    if (_channel && _playing) {
         _channel->setPaused(true);
         _playing = false;
-    }
-}
-
-void AudioManager::stop()
-{
-    if (_channel) {
-        _channel->stop();
-        _channel = nullptr;
-        _playing = false;
+        _pause_clock = _get_dsp_clock();
     }
     
-    // reset the track queue
-    while (!_completed_tracks.empty()) {
-        TrackRef cmp_track = _completed_tracks.top(); _completed_tracks.pop();
-        _track_queue.push_front(cmp_track);
-    }
+    // the scheduled start time of the next track is no longer valid
+    _cancel_scheduled_track();
 }
 
-bool AudioManager::is_playing()
+void AudioManager::_stop()
 {
-    return _playing;
+    _release_prefetched_track();
+    _complete_current_track();
+    
+    // rewind to the start of the playlist
+    _playlist.reset();
 }
 
-float AudioManager::get_volume()
+float AudioManager::_get_volume()
 {
     float volume = 0.f;
     if (_channel) {
@@ -158,56 +635,167 @@ float AudioManager::get_volume()
     return volume;
 }
 
-void AudioManager::set_volume(float vol)
+void AudioManager::_set_volume(float vol)
 {
     if (_channel) {
         _channel->setVolume(vol);
     }
+    if (_scheduled_channel) {
+        _scheduled_channel->setVolume(vol);
+    }
 }
 
-void AudioManager::next_track()
+void AudioManager::_skip_tracks(int offset)
 {
-    _complete_current_track();
-    
-    TrackRef next_track = _dequeue_track();
-    if (next_track.get()) {
-        _current_track = next_track;
-        play();
+    if (offset > 0) {
+        _cancel_scheduled_track();
+        _complete_current_track();
+        
+        // the cursor steps straight over the intermediate tracks without opening them
+        bool has_track = _playlist.advance(offset);
+        _release_prefetched_track();
+        if (has_track) {
+            _play();
+        }
+    } else if (offset < 0) {
+        if (_playlist.get_history_count() > 0) {
+            _complete_current_track();
+            _playlist.rewind(-offset);
+            
+            // the head of the queue changed, so drop whatever we opened ahead of time
+            _release_prefetched_track();
+            _play();
+        } else {
+            _stop();
+        }
     }
 }
 
-void AudioManager::previous_track()
+void AudioManager::_seek(long offset_ms)
 {
-    if (_completed_tracks.size() > 0) {
-        // release the stream and enqueue the current track
-        pause();
-        _current_track->release_stream();
-        _channel = nullptr;
-        _track_queue.push_front(_current_track);
-        
-        // pop the the last track and play
-        _current_track = _completed_tracks.top(); _completed_tracks.pop();
-        play();
-    } else {
-        stop();
+    size_t index = _playlist.get_cursor();
+    if (!_channel || index == Playlist::npos) {
+        return;
+    }
+    
+    Track &track = _get_track(index);
+    if (track._pcm_stream) {
+        // the ring only ever holds what's just ahead of the decoder
+        if (_decode_ahead_ms > 0) {
+            Logger::log_error("Seeking isn't supported while decoding ahead.");
+        } else {
+            Logger::log_error("Seeking isn't supported in a track started from the head cache.");
+        }
+        return;
+    }
+    
+    unsigned int position = 0, sound_length = 0;
+    float frequency = 0.f;
+    _channel->getPosition(&position, FMOD_TIMEUNIT_PCM);
+    track._stream->getLength(&sound_length, FMOD_TIMEUNIT_PCM);
+    track._stream->getDefaults(&frequency, NULL, NULL, NULL);
+    if (frequency <= 0.f) {
+        return;
+    }
+    
+    // without FMOD_ACCURATETIME the stream only has an estimate of how long a VBR file is
+    std::string filename = _playlist.get_table().get_filename(track.get_handle());
+    bool indexable = (_seek_indexer && track._load_mode == LoadMode::STREAM && SeekIndexer::supports_filename(filename));
+    std::shared_ptr<const SeekIndex> seek_index = (indexable ? _seek_indexer->find(filename) : nullptr);
+    unsigned long long length = (seek_index ? seek_index->length : (sound_length != 0xFFFFFFFF ? sound_length : 0));
+    
+    long long target = (long long) position + (long long) (offset_ms * (double) frequency / 1000.0);
+    if (length > 0 && target >= (long long) length) {
+        // past the end, carry on with the next track as if this one had finished
+        _skip_tracks(1);
+        return;
+    }
+    target = std::max(target, 0LL);
+    
+    // FMOD seeks to a byte offset it works out from the average bitrate, the file callbacks
+    // hand it the frame we looked up instead. it then believes it's exactly where we asked,
+    // so the position is snapped to the frame the index entry starts on.
+    bool redirected = false;
+    if (seek_index && track._file_stats && FileSystem::can_redirect_seeks()) {
+        size_t entry = seek_index->find_entry(target);
+        target = seek_index->get_entry_position(entry);
+        track._file_stats->seek_redirect.store(seek_index->offsets[entry]);
+        redirected = true;
+    }
+    
+    // streams are nonblocking, so FMOD carries out the seek later on its loader thread. the seek
+    // callback takes the redirect when it gets there, whatever is left after that was never used.
+    FMOD_RESULT result = _channel->setPosition((unsigned int) target, FMOD_TIMEUNIT_PCM);
+    if (redirected && result != FMOD_OK) {
+        track._file_stats->seek_redirect.store(-1);
+    } else if (redirected) {
+        _pending_seek = track.get_handle();
+    } else if (indexable) {
+        Logger::log_debug("Seek in %s is approximate, it hasn't been indexed.", Util::basename(filename).c_str());
     }
+    if (result != FMOD_OK) {
+        _print_error(result);
+        return;
+    }
+    
+    // the track now ends somewhere else, so the next one has to be lined up again
+    _cancel_scheduled_track();
+    unsigned long long now = _get_dsp_clock();
+    unsigned long long remaining = (length > 0 ? (unsigned long long) ((double) (length - target) * _output_rate / frequency) : 0);
+    _current_end_clock = (remaining > 0 ? now + remaining : 0);
+    if (!_playing) {
+        _pause_clock = now;
+    }
+    
+    unsigned int seconds = (unsigned int) (target / frequency);
+    Logger::log("Seeked to %u:%02u.", seconds / 60, seconds % 60);
 }
 
-#pragma mark - Updating
-
-void AudioManager::update(time_t time)
+void AudioManager::_jump_to_track(size_t index)
 {
-    _audio_system->update();
+    if (index < _playlist.size()) {
+        _cancel_scheduled_track();
+        _complete_current_track();
+        _playlist.seek(index);
+        _release_prefetched_track();
+        _play();
+    }
 }
 
-#pragma mark - Callbacks
+void AudioManager::_set_repeat(bool repeat)
+{
+    _playlist.set_repeat(repeat);
+    Logger::log("Repeat %s.", repeat ? "on" : "off");
+}
 
-void AudioManager::track_completion_callback(FMOD::Channel *channel)
+void AudioManager::_handle_track_end(FMOD::Channel *channel)
 {
-    if (get_queue_size() > 0) {
-        next_track();
+    if (channel != _channel) {
+        // a channel we already stopped or replaced
+        return;
+    }
+    
+    if (_scheduled_channel) {
+        // the next track has already been started on the DSP clock, just take it over
+        FMOD::Channel *next_channel = _scheduled_channel;
+        _scheduled_channel = nullptr;
+        _prefetched_index = Playlist::npos;
+        
+        _complete_current_track();
+        _playlist.advance();
+        _channel = next_channel;
+        _playing = true;
+        
+        const Track &track = _get_track(_playlist.get_cursor());
+        unsigned long long length = _get_output_length(track);
+        _current_end_clock = (length > 0 ? _current_end_clock + length : 0);
+        
+        Logger::log("Playing track %s...", __describe_track(_playlist.get_table(), track.get_handle()).c_str());
     } else {
         _complete_current_track();
+        if (_playlist.advance()) {
+            _play();
+        }
     }
 }
 
@@ -215,14 +803,26 @@ void AudioManager::track_completion_callback(FMOD::Channel *channel)
 
 bool AudioManager::supports_filename(std::string filename)
 {
-    static std::set<std::string> __supported_exts = {
+    return get_format_index(filename) >= 0;
+}
+
+int AudioManager::get_format_index(std::string filename)
+{
+    // the order here is persisted in the library index, only ever append to it
+    static const char *__supported_exts[] = {
         "WAV", "AIFF", "MP3", "OGG", "ASX", "FLAC", "DLS", "ASF", "IT",
         "MP2", "MOD", "RAW", "WAX", "WMA", "XM", "XMA", "S3M", "VAG", "GCADPCM"
     };
+    static const int __num_supported_exts = sizeof(__supported_exts) / sizeof(__supported_exts[0]);
     
     std::string extension = Util::filename_ext(filename);
     std::transform(extension.begin(), extension.end(), extension.begin(), ::toupper);
-    return __supported_exts.find(extension) != __supported_exts.end();
+    for (int i = 0; i < __num_supported_exts; ++i) {
+        if (extension == __supported_exts[i]) {
+            return i;
+        }
+    }
+    return -1;
 }
 
 #pragma mark - Internal
@@ -232,42 +832,516 @@ void AudioManager::_print_error(FMOD_RESULT result)
     Logger::log_error("FMOD Error %d: %s", result, FMOD_ErrorString(result));
 }
 
-void AudioManager::_load_track(TrackRef track)
+void AudioManager::_load_track(Track &track, bool critical)
 {
-    if (track->_stream == nullptr) {
-        FMOD::Sound *stream;
-        std::string filename = track->get_filename();
-        FMOD_RESULT result = _audio_system->createStream(filename.c_str(), FMOD_DEFAULT, NULL, &stream);
+    if (track._load_state != Track::LoadState::UNLOADED) {
+        return;
+    }
+    
+    // a track we played recently is still open, playSound starts it over from the beginning
+    if (_track_cache.take(track.get_handle(), track)) {
+        if (track._file_stats) {
+            track._file_stats->critical.store(critical);
+        }
+        _request_seek_index(track);
+        return;
+    }
+    
+    std::string filename = _playlist.get_table().get_filename(track.get_handle());
+    if (FileSystem::get_mode() != FileSystem::Mode::FMOD && !track._file_stats) {
+        track._file_stats = FileSystem::track_file(filename);
+    }
+    if (track._file_stats) {
+        track._file_stats->critical.store(critical);
+    }
+    
+    // short tracks and modules are loaded whole, everything else streams. the size is the one the
+    // scan saw, this thread can't afford to wait on the card for it.
+    unsigned long long file_size = _playlist.get_table().get_file_size(track.get_handle());
+    LoadDecision decision = _load_policy.choose(filename, file_size, __get_memory_available());
+    track._load_mode = decision.mode;
+    track._load_start_time = Util::current_time();
+    Logger::log_debug("Opening %s as a %s (%s).", Util::basename(filename).c_str(), LoadPolicy::get_mode_name(decision.mode), decision.reason);
+    _request_seek_index(track);
+    
+    // with its start already decoded, the track plays from that while the decoder catches up
+    bool streaming = (decision.mode == LoadMode::STREAM);
+    std::shared_ptr<const TrackHead> head = (_head_cache && streaming ? _head_cache->find(track.get_handle()) : nullptr);
+    if (streaming && (_decode_ahead_ms > 0 || head)) {
+        // our own decoder thread fills the ring, the sound is created once there's enough in it
+        unsigned buffer_ms = (_decode_ahead_ms > 0 ? _decode_ahead_ms : HEAD_STREAM_BUFFER_MS);
+        unsigned length_ms = _get_exact_length_ms(filename);
+        track._pcm_stream = PCMStream::open(_audio_system, filename, buffer_ms, head, length_ms);
+        track._load_state = Track::LoadState::LOADING;
+    } else {
+        _open_stream(track);
+    }
+}
+
+void AudioManager::_open_stream(Track &track)
+{
+    // returns immediately, the file is opened or loaded on FMOD's loader thread
+    FMOD::Sound *stream;
+    char filename[PATH_MAX];
+    _playlist.get_table().get_filename(track.get_handle(), filename, sizeof(filename));
+    FMOD_MODE mode = FMOD_DEFAULT | FMOD_NONBLOCKING | LoadPolicy::get_fmod_mode(track._load_mode);
+    FMOD_RESULT result = _audio_system->createSound(filename, mode, NULL, &stream);
+    if (result == FMOD_OK) {
+        track._stream = stream;
+        track._load_state = Track::LoadState::LOADING;
+    } else {
+        _print_error(result);
+        track._stream = nullptr;
+        track._load_state = Track::LoadState::FAILED;
+    }
+}
+
+void AudioManager::_update_load_state(Track &track)
+{
+    if (track._load_state != Track::LoadState::LOADING) {
+        return;
+    }
+    
+    if (track._pcm_stream) {
+        track._pcm_stream->update();
+        PCMStream::State state = track._pcm_stream->get_state();
+        if (state == PCMStream::State::READY) {
+            track._stream = track._pcm_stream->get_sound();
+            track._load_state = Track::LoadState::READY;
+            _load_policy.record_open(track._load_mode, (Util::current_time() - track._load_start_time) * 1000.0);
+        } else if (state == PCMStream::State::FAILED) {
+            // formats we can't size up front are left to FMOD's own streaming
+            track.release_stream();
+            _open_stream(track);
+        }
+        return;
+    }
+    
+    FMOD_OPENSTATE open_state;
+    FMOD_RESULT result = track._stream->getOpenState(&open_state, NULL, NULL, NULL);
+    if (open_state == FMOD_OPENSTATE_READY) {
+        track._load_state = Track::LoadState::READY;
+        
+        double open_time = (Util::current_time() - track._load_start_time) * 1000.0;
+        _load_policy.record_open(track._load_mode, open_time);
+        Logger::log_debug("Opened %s as a %s in %.1f ms.", _playlist.get_table().get_name(track.get_handle()),
+                          LoadPolicy::get_mode_name(track._load_mode), open_time);
+    } else if (open_state == FMOD_OPENSTATE_ERROR) {
+        _print_error(result);
+        _retire_stream(track);
+        track._load_state = Track::LoadState::FAILED;
+    }
+}
+
+void AudioManager::_start_pending_track()
+{
+    size_t index = _playlist.get_cursor();
+    if (!_play_pending || index == Playlist::npos) {
+        return;
+    }
+    
+    Track &track = _get_track(index);
+    _update_load_state(track);
+    
+    if (track._load_state == Track::LoadState::FAILED) {
+        // skip it and try the next one on the following update
+        Logger::log_error("Unable to play track %s, skipping.", _playlist.get_table().get_name(track.get_handle()));
+        
+        _complete_current_track();
+        if (_playlist.advance()) {
+            _load_track(_get_track(_playlist.get_cursor()), true);
+            _play_pending = true;
+        }
+    } else if (track._load_state == Track::LoadState::READY) {
+        _play_pending = false;
+        
+        FMOD::Channel *channel;
+        FMOD_RESULT result = _audio_system->playSound(FMOD_CHANNEL_FREE, track._stream, false, &channel);
         if (result == FMOD_OK) {
-            track->_stream = stream;
+            // configure the channel
+            channel->setUserData(this);
+            channel->setCallback(__channel_callback);
+            
+            // store related memory
+            _playing = true;
+            _channel = channel;
+            
+            // remember when this track will run out so the next one can be lined up behind it
+            unsigned int start_hi = 0, start_lo = 0;
+            channel->getDelay(FMOD_DELAYTYPE_DSPCLOCK_START, &start_hi, &start_lo);
+            unsigned long long start_clock = ((unsigned long long) start_hi << 32) | start_lo;
+            unsigned long long length = _get_output_length(track);
+            _current_end_clock = (length > 0 ? start_clock + length : 0);
+            
+            // log current track
+            Logger::log("Playing track %s...", __describe_track(_playlist.get_table(), track.get_handle()).c_str());
         } else {
             _print_error(result);
-            track->_stream = nullptr;
         }
     }
 }
 
-TrackRef AudioManager::_dequeue_track()
+void AudioManager::_retire_stream(Track &track)
 {
-    TrackRef track = nullptr;
-    if (_track_queue.size() > 0) {
-        track = _track_queue.front();
-        _track_queue.pop_front();
+    // releasing a sound that is still opening would stall until the open finishes,
+    // so hand it over to update() to release once FMOD is done with it
+    if (track._pcm_stream) {
+        // user sounds never block on an open, and the decoder winds itself down
+        track.release_stream();
+    } else if (track._stream) {
+        _retired_streams.push_back(track._stream);
+        track._stream = nullptr;
     }
-    return track;
+    track._load_state = Track::LoadState::UNLOADED;
 }
 
-void AudioManager::_complete_current_track()
+void AudioManager::_cache_stream(Track &track)
 {
-    if (_current_track.get()) {
-        _current_track->release_stream();
-        _completed_tracks.push(_current_track);
-        _current_track = nullptr;
+    // decode-ahead rings, including the ones behind a cached head, can't be rewound,
+    // and streams still opening aren't worth keeping
+    if (track._pcm_stream) {
+        Logger::log_debug("Not caching %s, it was decoded ahead.",
+                          Util::basename(_playlist.get_table().get_filename(track.get_handle())).c_str());
     }
-    
+    if (track._load_state == Track::LoadState::READY && track._stream && !track._pcm_stream) {
+        unsigned int used = 0;
+        FMOD_MEMORY_USAGE_DETAILS details;
+        if (track._stream->getMemoryInfo(FMOD_MEMBITS_ALL, 0, &used, &details) == FMOD_OK) {
+            if (track._file_stats) {
+                track._file_stats->critical.store(false);
+            }
+            if (_track_cache.insert(track, used)) {
+                return;
+            }
+        }
+    }
+    _retire_stream(track);
+}
+
+void AudioManager::_release_retired_streams(bool force)
+{
+    auto itr = _retired_streams.begin();
+    while (itr != _retired_streams.end()) {
+        FMOD::Sound *sound = *itr;
+        FMOD_OPENSTATE open_state = FMOD_OPENSTATE_READY;
+        sound->getOpenState(&open_state, NULL, NULL, NULL);
+        
+        if (force || open_state == FMOD_OPENSTATE_READY || open_state == FMOD_OPENSTATE_ERROR) {
+            sound->release();
+            itr = _retired_streams.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+}
+
+void AudioManager::_complete_current_track()
+{
     if (_channel) {
+        _stop_channel(_channel);
         _channel = nullptr;
     }
+    
+    size_t index = _playlist.get_cursor();
+    Track *track = (index != Playlist::npos ? _find_track(_playlist.at(index)) : nullptr);
+    if (track && _track_cpu_samples > 0) {
+        double cpu = _track_cpu_total / _track_cpu_samples;
+        _load_policy.record_playback(track->_load_mode, cpu);
+        Logger::log_debug("Played %s as a %s, %.1f%% CPU.", _playlist.get_table().get_name(track->get_handle()),
+                          LoadPolicy::get_mode_name(track->_load_mode), cpu);
+    }
+    _track_cpu_total = 0.0;
+    _track_cpu_samples = 0;
+    
+    if (track) {
+        _cache_stream(*track);
+    }
+    
+    _playing = false;
+    _play_pending = false;
+}
+
+void AudioManager::_stop_channel(FMOD::Channel *channel)
+{
+    // detach first so the stop doesn't come back to us as a track completion
+    channel->setUserData(nullptr);
+    channel->stop();
+}
+
+Track& AudioManager::_get_track(size_t index)
+{
+    TrackHandle handle = _playlist.at(index);
+    Track *track = _find_track(handle);
+    if (!track) {
+        _loaded_tracks.push_back(Track(handle));
+        track = &_loaded_tracks.back();
+    }
+    return *track;
+}
+
+Track* AudioManager::_find_track(TrackHandle handle)
+{
+    for (auto &track : _loaded_tracks) {
+        if (track.get_handle() == handle) {
+            return &track;
+        }
+    }
+    return nullptr;
+}
+
+void AudioManager::_prune_tracks()
+{
+    // only the handful of tracks with open streams are kept around
+    auto itr = _loaded_tracks.begin();
+    while (itr != _loaded_tracks.end()) {
+        if (itr->_load_state == Track::LoadState::UNLOADED && !itr->_stream) {
+            itr = _loaded_tracks.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+}
+
+void AudioManager::_update_io_priority()
+{
+    // whatever the cursor is on is what playback depends on, including a track taken over from
+    // the schedule. background reads are held back while its buffer runs low.
+    float level = 1.f;
+    size_t index = _playlist.get_cursor();
+    Track *track = (index != Playlist::npos ? _find_track(_playlist.at(index)) : nullptr);
+    if (track && track->_file_stats) {
+        track->_file_stats->critical.store(true);
+    }
+    
+    if (track && _channel) {
+        if (track->_pcm_stream) {
+            level = track->_pcm_stream->get_fill_level();
+        } else if (track->_stream) {
+            FMOD_OPENSTATE open_state;
+            unsigned int percent_buffered = 100;
+            bool starving = false;
+            track->_stream->getOpenState(&open_state, &percent_buffered, &starving, NULL);
+            level = (starving ? 0.f : percent_buffered / 100.f);
+        }
+    }
+    IoScheduler::set_playback_buffer(level);
+}
+
+void AudioManager::_update_head_window()
+{
+    size_t cursor = _playlist.get_cursor();
+    if (!_head_cache || (cursor == _head_window_cursor && _playlist.size() == _head_window_playlist_size)) {
+        return;
+    }
+    _head_window_cursor = cursor;
+    _head_window_playlist_size = _playlist.size();
+    
+    // the tracks right after the cursor, wherever a few presses of next might land
+    std::vector<HeadRequest> window;
+    const TrackTable &table = _playlist.get_table();
+    for (size_t i = cursor + 1; cursor != Playlist::npos && i < _playlist.size() && window.size() < _head_window; ++i) {
+        HeadRequest request;
+        request.handle = _playlist.at(i);
+        request.filename = table.get_filename(request.handle);
+        request.length_ms = _get_exact_length_ms(request.filename);
+        window.push_back(request);
+    }
+    _head_cache->set_window(window);
+}
+
+void AudioManager::_check_decoder()
+{
+    size_t index = _playlist.get_cursor();
+    Track *track = (_channel && index != Playlist::npos ? _find_track(_playlist.at(index)) : nullptr);
+    if (!track || !track->_pcm_stream || !track->_stream) {
+        return;
+    }
+    
+    // a decoder that gives up once its sound is playing, say a head whose file went away, would
+    // otherwise leave the track playing silence for the rest of its length
+    const PCMStream &stream = *track->_pcm_stream;
+    if (stream.is_exhausted() && stream.is_failed()) {
+        Logger::log_error("Unable to play the rest of %s, skipping.", _playlist.get_table().get_name(track->get_handle()));
+        _skip_tracks(1);
+        return;
+    }
+    
+    // the sound's length was open-ended or came from the seek index, now the decoder knows it exactly
+    unsigned int length = stream.get_decoded_length();
+    unsigned int position = 0;
+    float frequency = 0.f;
+    track->_stream->getDefaults(&frequency, NULL, NULL, NULL);
+    if (length == 0 || frequency <= 0.f || _channel->getPosition(&position, FMOD_TIMEUNIT_PCM) != FMOD_OK) {
+        return;
+    }
+    
+    if (position >= length) {
+        // what's left is padding, end it the way FMOD would have at the end of its length
+        _handle_track_end(_channel);
+        return;
+    }
+    
+    unsigned long long now = (_playing ? _get_dsp_clock() : _pause_clock);
+    unsigned long long end_clock = now + (unsigned long long) ((double) (length - position) * _output_rate / frequency);
+    unsigned long long tolerance = (unsigned long long) _output_rate * END_CLOCK_TOLERANCE_MS / 1000;
+    if (end_clock + tolerance < _current_end_clock || end_clock > _current_end_clock + tolerance) {
+        // the next track is lined up again on the following update
+        _cancel_scheduled_track();
+        _current_end_clock = end_clock;
+    }
+}
+
+void AudioManager::_check_pending_seek()
+{
+    Track *track = (_pending_seek != TrackTable::invalid_handle ? _find_track(_pending_seek) : nullptr);
+    if (!track || !track->_stream || !track->_file_stats) {
+        _pending_seek = TrackTable::invalid_handle;
+        return;
+    }
+    
+    FMOD_OPENSTATE open_state = FMOD_OPENSTATE_READY;
+    track->_stream->getOpenState(&open_state, NULL, NULL, NULL);
+    if (open_state == FMOD_OPENSTATE_SETPOSITION) {
+        return;
+    }
+    
+    _pending_seek = TrackTable::invalid_handle;
+    if (track->_file_stats->seek_redirect.exchange(-1) >= 0) {
+        // it never went back to the file, so it's wherever FMOD thought it was
+        std::string filename = _playlist.get_table().get_filename(track->get_handle());
+        Logger::log_debug("Seek in %s didn't reach the file.", Util::basename(filename).c_str());
+    }
+}
+
+void AudioManager::_sample_cpu_usage()
+{
+    // FMOD only measures its threads as a whole, so it's all charged to whatever is playing
+    if (_channel && _playing) {
+        float dsp = 0.f, stream = 0.f;
+        _audio_system->getCPUUsage(&dsp, &stream, NULL, NULL, NULL);
+        _track_cpu_total += dsp + stream;
+        ++_track_cpu_samples;
+    }
+}
+
+void AudioManager::_request_seek_index(const Track &track)
+{
+    // loaded whole, FMOD seeks those exactly on its own
+    if (_seek_indexer && track._load_mode == LoadMode::STREAM) {
+        _seek_indexer->request(_playlist.get_table().get_filename(track.get_handle()));
+    }
+}
+
+unsigned AudioManager::_get_exact_length_ms(const std::string &filename)
+{
+    // a seek index counted every frame. durations from tags can be a tagger's guess, so they're
+    // only for show, a decoded stream finds its own end instead.
+    std::shared_ptr<const SeekIndex> seek_index = (_seek_indexer ? _seek_indexer->find(filename) : nullptr);
+    if (seek_index && seek_index->frequency > 0) {
+        return (unsigned) (seek_index->length * 1000 / seek_index->frequency);
+    }
+    return 0;
+}
+
+#pragma mark - Gapless Playback
+
+unsigned long long AudioManager::_get_dsp_clock()
+{
+    unsigned int hi = 0, lo = 0;
+    _audio_system->getDSPClock(&hi, &lo);
+    return ((unsigned long long) hi << 32) | lo;
+}
+
+unsigned long long AudioManager::_get_output_length(const Track &track)
+{
+    unsigned long long output_length = 0;
+    FMOD::Sound *sound = track._stream;
+    
+    unsigned int length = 0;
+    float frequency = 0.f;
+    if (sound &&
+        sound->getLength(&length, FMOD_TIMEUNIT_PCM) == FMOD_OK &&
+        sound->getDefaults(&frequency, NULL, NULL, NULL) == FMOD_OK &&
+        length > 0 && length != 0xFFFFFFFF && frequency > 0.f)
+    {
+        // convert from the sound's sample rate to ticks of the mixer clock
+        output_length = (unsigned long long) ((double) length * _output_rate / frequency);
+    }
+    
+    return output_length;
+}
+
+void AudioManager::_prefetch_next_track()
+{
+    size_t next = _playlist.get_next();
+    if (_prefetched_index != Playlist::npos && _prefetched_index != next) {
+        _release_prefetched_track();
+    }
+    
+    size_t current = _playlist.get_cursor();
+    if (current == Playlist::npos || next == Playlist::npos || next == current) {
+        return;
+    }
+    
+    // open the next track while the current one is still playing
+    Track &track = _get_track(next);
+    _load_track(track, false);
+    _update_load_state(track);
+    
+    if (track._stream || track._pcm_stream) {
+        _prefetched_index = next;
+        if (_playing && !_scheduled_channel && track._load_state == Track::LoadState::READY) {
+            _schedule_track(track);
+        }
+    }
+}
+
+void AudioManager::_schedule_track(Track &track)
+{
+    unsigned long long now = _get_dsp_clock();
+    unsigned long long lookahead = (unsigned long long) _output_rate * SCHEDULE_LOOKAHEAD_MS / 1000;
+    if (_current_end_clock <= now || _current_end_clock - now > lookahead) {
+        // unknown length, already overdue, or too early to commit a channel
+        return;
+    }
+    
+    // start paused so the stream buffer fills, then release it on the exact tick the current track ends
+    FMOD::Channel *channel;
+    FMOD_RESULT result = _audio_system->playSound(FMOD_CHANNEL_FREE, track._stream, true, &channel);
+    if (result != FMOD_OK) {
+        _print_error(result);
+        return;
+    }
+    
+    channel->setVolume(_get_volume());
+    channel->setDelay(FMOD_DELAYTYPE_DSPCLOCK_START, (unsigned int) (_current_end_clock >> 32), (unsigned int) _current_end_clock);
+    channel->setUserData(this);
+    channel->setCallback(__channel_callback);
+    channel->setPaused(false);
+    
+    _scheduled_channel = channel;
+}
+
+void AudioManager::_cancel_scheduled_track()
+{
+    if (_scheduled_channel) {
+        _stop_channel(_scheduled_channel);
+        _scheduled_channel = nullptr;
+    }
+}
+
+void AudioManager::_release_prefetched_track()
+{
+    _cancel_scheduled_track();
+    
+    // if the cursor has landed on the prefetched track its stream is now the current one
+    if (_prefetched_index != Playlist::npos && _prefetched_index != _playlist.get_cursor()) {
+        Track *track = _find_track(_playlist.at(_prefetched_index));
+        if (track) {
+            _cache_stream(*track);
+        }
+    }
+    _prefetched_index = Playlist::npos;
 }
 
 } // namespace djpi
@@ -7,12 +7,22 @@
  
 #pragma once
 
+#include <atomic>
 #include <cstring>
 #include <fmod/fmod.hpp>
-#include <deque>
-#include <stack>
+#include <functional>
+#include <set>
 #include <time.h>
+#include <vector>
+#include "command_queue.h"
+#include "file_system.h"
+#include "head_cache.h"
+#include "latency_profile.h"
+#include "load_policy.h"
+#include "playlist.h"
+#include "seek_index.h"
 #include "track.h"
+#include "track_cache.h"
 
 namespace djpi {
 
@@ -21,23 +31,40 @@ public:
     AudioManager();
     ~AudioManager();
     
-    // managing tracks
-    void enqueue_track(TrackRef track);
-    void clear_track_queue();
-    size_t get_queue_size();
-    TrackRef get_current_track() const { return _current_track; }
+    // configuration, only before init()
+    void set_latency_profile(const LatencyProfile &profile) { _profile = profile; }
+    void set_decode_ahead(unsigned buffer_ms) { _decode_ahead_ms = buffer_ms; } // 0 leaves streaming to FMOD
+    void set_file_io(FileSystem::Mode mode) { _file_io = mode; }
+    void set_memory_budget(size_t bytes) { _memory_budget = bytes; } // 0 leaves FMOD on the system heap
+    void set_memory_report_interval(unsigned seconds) { _memory_report_interval = seconds; } // 0 only reports on request
+    void set_track_cache_budget(size_t bytes) { _track_cache.set_budget(bytes); } // 0 disables it
+    void set_head_cache_window(size_t tracks) { _head_window = tracks; } // 0 disables it, tracks started from a head can't seek
+    void set_head_size(size_t bytes) { _head_size = bytes; }
+    void set_seek_index_directory(const std::string &directory) { _seek_index_directory = directory; } // empty disables indexing
+    void set_state_handler(std::function<void()> handler) { _state_handler = handler; } // called on the engine thread
+    void init();
     
-    // controlling playback
+    // controlling playback. these only post a command, so they're safe to call from any
+    // thread. the engine applies them on its next update().
+    bool post(Command command);
     void play();
     void pause();
+    void toggle_pause();
     void stop();
-    bool is_playing();
-    float get_volume();
+    void skip_tracks(int offset); // negative values go back
+    void seek(int offset_ms); // within the current track, negative values go back
+    void jump_to_track(size_t index);
+    void set_repeat(bool repeat);
+    void toggle_repeat();
     void set_volume(float vol); // 0.0 - 1.0
-    void next_track();
-    void previous_track();
+    void enqueue_tracks(std::vector<std::string> filenames, std::vector<TrackInfo> infos); // one info per filename
+    void update_library(std::vector<std::string> added, std::vector<TrackInfo> added_infos, std::set<std::string> removed); // removed paths can be directories
+    void print_status(); // logged from the engine thread
+    
+    // state published by the engine
+    bool is_idle() const; // nothing playing or queued
     
-    // updating
+    // updating, only ever called from the thread that owns the engine
     void update(time_t time);
     
     // callbacks
@@ -45,20 +72,102 @@ public:
     
     // static methods
     static bool supports_filename(std::string filename);
-    
+    static int get_format_index(std::string filename); // -1 if unsupported
+
 private:
     void _print_error(FMOD_RESULT result);
-    void _load_track(TrackRef track);
-    TrackRef _dequeue_track();
+    
+    // commands
+    size_t _process_commands();
+    void _handle_command(const Command &command);
+    void _print_status();
+    
+    // managing tracks
+    void _enqueue_tracks(const std::vector<std::string> &filenames, const std::vector<TrackInfo> &infos);
+    void _update_library(const std::vector<std::string> &added, const std::vector<TrackInfo> &added_infos, const std::set<std::string> &removed);
+    void _clear_track_queue();
+    size_t _remove_tracks(const std::set<std::string> &paths);
+    
+    // playback
+    void _play();
+    void _pause();
+    void _stop();
+    float _get_volume();
+    void _set_volume(float vol);
+    void _skip_tracks(int offset);
+    void _seek(long offset_ms);
+    void _jump_to_track(size_t index);
+    void _set_repeat(bool repeat);
+    void _handle_track_end(FMOD::Channel *channel);
+    
+    // streams
+    void _load_track(Track &track, bool critical); // critical if playback is waiting on it
+    void _open_stream(Track &track);
+    void _update_load_state(Track &track);
+    void _start_pending_track();
+    void _retire_stream(Track &track);
+    void _cache_stream(Track &track); // keeps it for replaying if there's room, otherwise retires it
+    void _release_retired_streams(bool force);
     void _complete_current_track();
+    void _stop_channel(FMOD::Channel *channel);
+    Track& _get_track(size_t index); // references are only valid until the next call
+    Track* _find_track(TrackHandle handle);
+    void _prune_tracks();
+    void _update_io_priority();
+    void _print_memory_usage();
+    void _update_head_window();
+    void _check_decoder();
+    void _check_pending_seek(); // once FMOD has carried out a redirected seek
+    void _sample_cpu_usage();
+    void _request_seek_index(const Track &track);
+    unsigned _get_exact_length_ms(const std::string &filename); // 0 until the file has been indexed
+    
+    // gapless playback
+    unsigned long long _get_dsp_clock();
+    unsigned long long _get_output_length(const Track &track);
+    void _prefetch_next_track();
+    void _schedule_track(Track &track);
+    void _cancel_scheduled_track();
+    void _release_prefetched_track();
 
 protected:
     FMOD::System *_audio_system;
     FMOD::Channel *_channel;
-    std::deque<TrackRef> _track_queue;
-    std::stack<TrackRef> _completed_tracks;
-    TrackRef _current_track;
+    Playlist _playlist;
+    std::vector<Track> _loaded_tracks; // tracks with an open stream, looked up by handle
     bool _playing;
+    bool _play_pending;
+    std::vector<FMOD::Sound *> _retired_streams;
+    TrackCache _track_cache;
+    std::shared_ptr<HeadCache> _head_cache;
+    size_t _head_window;
+    size_t _head_size;
+    size_t _head_window_cursor;
+    size_t _head_window_playlist_size;
+    LoadPolicy _load_policy;
+    std::shared_ptr<SeekIndexer> _seek_indexer;
+    std::string _seek_index_directory;
+    double _track_cpu_total; // summed over the updates the current track has been playing for
+    size_t _track_cpu_samples;
+    LatencyProfile _profile;
+    unsigned _decode_ahead_ms;
+    FileSystem::Mode _file_io;
+    size_t _memory_budget;
+    unsigned _memory_report_interval;
+    time_t _last_memory_report;
+    
+    int _output_rate;
+    size_t _prefetched_index;
+    FMOD::Channel *_scheduled_channel;
+    unsigned long long _current_end_clock;
+    unsigned long long _pause_clock;
+    TrackHandle _pending_seek; // a redirected seek FMOD hasn't carried out yet, or invalid_handle
+    
+    CommandQueue _commands;
+    std::atomic<size_t> _posted_count;
+    std::atomic<size_t> _processed_count;
+    std::atomic<bool> _idle;
+    std::function<void()> _state_handler; // lets the owner know the published state may have changed
 };
 
 } // namespace djpi
@@ -0,0 +1,71 @@
+/*
+ * command_queue.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "command_queue.h"
+#include <utility>
+
+static size_t __next_power_of_two(size_t value)
+{
+    size_t result = 2;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+namespace djpi {
+
+CommandQueue::CommandQueue(size_t capacity) :
+    _slots(__next_power_of_two(capacity)),
+    _mask(_slots.size() - 1),
+    _push_position(0),
+    _pop_position(0)
+{
+    for (size_t i = 0; i < _slots.size(); ++i) {
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+}
+
+bool CommandQueue::push(Command command)
+{
+    // each slot's sequence says whose turn it is: == position when free, position + 1 once filled
+    size_t position = _push_position.load(std::memory_order_relaxed);
+    Slot *slot;
+    while (true) {
+        slot = &_slots[position & _mask];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        if (sequence == position) {
+            if (_push_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (sequence < position) {
+            return false;
+        } else {
+            position = _push_position.load(std::memory_order_relaxed);
+        }
+    }
+    
+    slot->command = std::move(command);
+    slot->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool CommandQueue::pop(Command &command_out)
+{
+    Slot &slot = _slots[_pop_position & _mask];
+    if (slot.sequence.load(std::memory_order_acquire) != _pop_position + 1) {
+        return false;
+    }
+    
+    command_out = std::move(slot.command);
+    slot.command = Command(); // drop any payload now rather than a lap later
+    slot.sequence.store(_pop_position + _slots.size(), std::memory_order_release);
+    ++_pop_position;
+    return true;
+}
+
+} // namespace djpi
@@ -0,0 +1,75 @@
+/*
+ * command_queue.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+#include "track_table.h"
+
+namespace FMOD {
+    class Channel;
+}
+
+namespace djpi {
+
+struct Command {
+    enum class Type {
+        PLAY,
+        PAUSE,
+        TOGGLE_PAUSE,
+        STOP,
+        SKIP,               // value = offset, negative goes back
+        SEEK,               // value = offset in milliseconds, negative goes back
+        JUMP,               // value = playlist index
+        SET_REPEAT,         // value = 0 or 1
+        TOGGLE_REPEAT,
+        SET_VOLUME,         // volume
+        ENQUEUE_TRACKS,     // filenames and infos, starts playback if nothing is playing
+        UPDATE_LIBRARY,     // filenames and infos added, paths removed
+        TRACK_ENDED,        // channel
+        PRINT_STATUS
+    };
+    
+    Command(Type type = Type::PLAY, long value = 0) :
+        type(type), value(value), volume(0.f), channel(nullptr)
+    {}
+    
+    Type type;
+    long value;
+    float volume;
+    FMOD::Channel *channel;
+    std::shared_ptr<std::vector<std::string>> filenames;
+    std::shared_ptr<std::vector<TrackInfo>> infos; // one per filename
+    std::shared_ptr<std::set<std::string>> paths;
+};
+
+// Bounded lock-free queue that any thread can post commands to, drained by the single
+// thread that owns the audio engine.
+class CommandQueue {
+public:
+    CommandQueue(size_t capacity); // rounded up to a power of two
+    
+    bool push(Command command); // false if the queue is full
+    bool pop(Command &command_out); // consumer only
+
+protected:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        Command command;
+    };
+    
+    std::vector<Slot> _slots;
+    size_t _mask;
+    std::atomic<size_t> _push_position;
+    size_t _pop_position;
+};
+
+} // namespace djpi
@@ -0,0 +1,159 @@
+/*
+ * engine_thread.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "engine_thread.h"
+#include "audio_manager.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#define DEFAULT_UPDATE_RATE 50
+#define LOCKED_STACK_SIZE   (256 * 1024)
+
+#ifdef __linux__
+static void __attribute__((noinline)) __lock_stack()
+{
+    // touched and locked from below our own frame, so the engine thread's calls down into
+    // FMOD never have to fault in a page of stack
+    volatile char stack[LOCKED_STACK_SIZE];
+    for (size_t i = 0; i < sizeof(stack); i += 1024) {
+        stack[i] = 0;
+    }
+    if (mlock((const void *) stack, sizeof(stack)) != 0) {
+        djpi::Logger::log_error("Warning: couldn't lock the audio engine's stack (%s).", strerror(errno));
+    }
+}
+#endif
+
+namespace djpi {
+
+EngineThread::EngineThread(std::shared_ptr<AudioManager> audio) :
+    _audio(audio),
+    _running(false),
+    _update_rate(DEFAULT_UPDATE_RATE),
+    _rt_priority(0),
+    _cpu(-1),
+    _lock_memory(false),
+    _late_update_count(0),
+    _max_update_time(0.0)
+{}
+
+EngineThread::~EngineThread()
+{
+    stop();
+}
+
+#pragma mark - Running
+
+void EngineThread::start()
+{
+    if (_running.load()) {
+        return;
+    }
+    
+    if (_update_rate == 0) {
+        _update_rate = DEFAULT_UPDATE_RATE;
+    }
+    
+    // from here on the audio manager is only ever touched by the engine thread, until stop() joins it
+    _running.store(true);
+    _thread = std::thread(&EngineThread::_thread_main, this);
+}
+
+void EngineThread::stop()
+{
+    _running.store(false);
+    if (_thread.joinable()) {
+        _thread.join();
+    }
+}
+
+#pragma mark - Internal
+
+void EngineThread::_thread_main()
+{
+    _apply_scheduling();
+    if (_lock_memory) {
+        _lock_process_memory();
+    }
+    
+    typedef std::chrono::steady_clock clock;
+    clock::duration period = std::chrono::nanoseconds(1000000000LL / _update_rate);
+    clock::time_point next_update = clock::now();
+    
+    while (_running.load()) {
+        clock::time_point start = clock::now();
+        _audio->update(time(NULL));
+        clock::time_point end = clock::now();
+        
+        double update_time = std::chrono::duration<double>(end - start).count();
+        if (update_time > _max_update_time.load()) {
+            _max_update_time.store(update_time);
+        }
+        
+        next_update += period;
+        if (end > next_update) {
+            // fell behind, start again from now rather than trying to catch up with a burst of updates
+            _late_update_count.fetch_add(1);
+            next_update = end;
+        }
+        std::this_thread::sleep_until(next_update);
+    }
+}
+
+void EngineThread::_apply_scheduling()
+{
+    if (_rt_priority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = std::min(_rt_priority, sched_get_priority_max(SCHED_FIFO));
+        
+        int result = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (result != 0) {
+            Logger::log_error("Warning: couldn't give the audio engine real-time priority (%s).", strerror(result));
+        }
+    }
+    
+    if (_cpu >= 0) {
+#ifdef __linux__
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(_cpu, &cpus);
+        
+        int result = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+        if (result != 0) {
+            Logger::log_error("Warning: couldn't pin the audio engine to CPU %d (%s).", _cpu, strerror(result));
+        }
+#else
+        Logger::log_error("Warning: pinning the audio engine to a CPU is only supported on Linux.");
+#endif
+    }
+}
+
+void EngineThread::_lock_process_memory()
+{
+#ifdef __linux__
+#ifdef MCL_ONFAULT
+    // only what's already resident, and the rest of the existing mappings as they're first
+    // touched. the untouched part of FMOD's arena isn't pinned up front, and nothing mapped
+    // later is locked, so file windows and new threads' stacks stay pageable.
+    if (mlockall(MCL_CURRENT | MCL_ONFAULT) != 0) {
+        Logger::log_error("Warning: couldn't lock audio engine memory (%s).", strerror(errno));
+    }
+#endif
+    __lock_stack();
+#endif
+}
+
+} // namespace djpi
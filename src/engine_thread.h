@@ -0,0 +1,60 @@
+/*
+ * engine_thread.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+namespace djpi {
+
+class AudioManager;
+
+// Runs the audio engine's update tick on its own thread, optionally with real-time priority,
+// pinned to a core and with the process memory locked, so terminal output, scanning and
+// everything else on the main loop can't starve the streams.
+class EngineThread {
+public:
+    EngineThread(std::shared_ptr<AudioManager> audio);
+    ~EngineThread();
+    
+    // configuration, takes effect on start()
+    void set_update_rate(unsigned rate_hz) { _update_rate = rate_hz; }
+    void set_rt_priority(int priority) { _rt_priority = priority; } // SCHED_FIFO priority, 0 for normal scheduling
+    void set_cpu(int cpu) { _cpu = cpu; } // -1 lets the scheduler choose
+    void set_lock_memory(bool lock) { _lock_memory = lock; }
+    
+    // running
+    void start();
+    void stop();
+    
+    // statistics
+    unsigned get_update_rate() const { return _update_rate; }
+    size_t get_late_update_count() const { return _late_update_count.load(); }
+    double get_max_update_time() const { return _max_update_time.load(); } // seconds
+
+private:
+    void _thread_main();
+    void _apply_scheduling();
+    void _lock_process_memory();
+
+protected:
+    std::shared_ptr<AudioManager> _audio;
+    std::thread _thread;
+    std::atomic<bool> _running;
+    
+    unsigned _update_rate;
+    int _rt_priority;
+    int _cpu;
+    bool _lock_memory;
+    
+    std::atomic<size_t> _late_update_count;
+    std::atomic<double> _max_update_time;
+};
+
+} // namespace djpi
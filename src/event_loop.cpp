@@ -0,0 +1,272 @@
+/*
+ * event_loop.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "event_loop.h"
+#include "logger.h"
+#include "util.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#else
+#include <sys/select.h>
+#endif
+
+#define MAX_EVENTS          16
+#define DEFAULT_TICK_RATE   50
+
+namespace djpi {
+
+EventLoop::EventLoop() :
+    _poll_fd(-1),
+    _timer_fd(-1),
+    _tick_rate(DEFAULT_TICK_RATE),
+    _next_tick_time(0.0),
+    _running(false),
+    _wakeup_count(0),
+    _wakeup_rate(0),
+    _wakeup_window(0)
+{
+    _wakeup_fds[0] = _wakeup_fds[1] = -1;
+
+#ifdef __linux__
+    _poll_fd = epoll_create1(EPOLL_CLOEXEC);
+    _timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    _wakeup_fds[0] = _wakeup_fds[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (_poll_fd < 0 || _timer_fd < 0 || _wakeup_fds[0] < 0) {
+        Logger::log_error("Failed to create event loop (errno %d).", errno);
+        exit(-1);
+    }
+    
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.fd = _timer_fd;
+    epoll_ctl(_poll_fd, EPOLL_CTL_ADD, _timer_fd, &ev);
+    ev.data.fd = _wakeup_fds[0];
+    epoll_ctl(_poll_fd, EPOLL_CTL_ADD, _wakeup_fds[0], &ev);
+#else
+    // no epoll here, fall back to select() with a self-pipe for wakeups
+    if (pipe(_wakeup_fds) != 0) {
+        Logger::log_error("Failed to create event loop (errno %d).", errno);
+        exit(-1);
+    }
+    fcntl(_wakeup_fds[0], F_SETFL, O_NONBLOCK);
+    fcntl(_wakeup_fds[1], F_SETFL, O_NONBLOCK);
+#endif
+}
+
+EventLoop::~EventLoop()
+{
+    if (_wakeup_fds[1] != _wakeup_fds[0]) {
+        close(_wakeup_fds[1]);
+    }
+    if (_wakeup_fds[0] >= 0) {
+        close(_wakeup_fds[0]);
+    }
+    if (_timer_fd >= 0) {
+        close(_timer_fd);
+    }
+    if (_poll_fd >= 0) {
+        close(_poll_fd);
+    }
+}
+
+#pragma mark - Registering Event Sources
+
+void EventLoop::add_fd(int fd, EventHandler handler)
+{
+    _handlers[fd] = handler;
+    
+#ifdef __linux__
+    struct epoll_event ev = {0};
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(_poll_fd, EPOLL_CTL_ADD, fd, &ev) != 0) {
+        // regular files and /dev/null can't be polled, there's never anything to wait for on them
+        Logger::log_debug("Not watching fd %d (errno %d).", fd, errno);
+        _handlers.erase(fd);
+    }
+#endif
+}
+
+void EventLoop::remove_fd(int fd)
+{
+    _handlers.erase(fd);
+    
+#ifdef __linux__
+    epoll_ctl(_poll_fd, EPOLL_CTL_DEL, fd, NULL);
+#endif
+}
+
+void EventLoop::set_tick(unsigned rate_hz, EventHandler handler)
+{
+    _tick_rate = (rate_hz > 0 ? rate_hz : DEFAULT_TICK_RATE);
+    _tick_handler = handler;
+    _next_tick_time = Util::current_time();
+    
+#ifdef __linux__
+    long interval_ns = 1000000000L / _tick_rate;
+    struct itimerspec spec = {{0}};
+    spec.it_interval.tv_sec = interval_ns / 1000000000L;
+    spec.it_interval.tv_nsec = interval_ns % 1000000000L;
+    spec.it_value = spec.it_interval;
+    timerfd_settime(_timer_fd, 0, &spec, NULL);
+#endif
+}
+
+void EventLoop::set_wakeup_handler(EventHandler handler)
+{
+    _wakeup_handler = handler;
+}
+
+#pragma mark - Running
+
+void EventLoop::run()
+{
+    _running = true;
+    while (_running) {
+        _wait_for_events();
+    }
+}
+
+void EventLoop::stop()
+{
+    _running = false;
+}
+
+void EventLoop::wakeup()
+{
+    uint64_t one = 1;
+    ssize_t written = write(_wakeup_fds[1], &one, sizeof(one));
+    (void) written; // a full pipe already guarantees a wakeup
+}
+
+#pragma mark - Internal
+
+void EventLoop::_wait_for_events()
+{
+#ifdef __linux__
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(_poll_fd, events, MAX_EVENTS, -1);
+    if (count <= 0) {
+        return;
+    }
+    
+    _count_wakeup();
+    for (int i = 0; i < count && _running; ++i) {
+        int fd = events[i].data.fd;
+        if (fd == _timer_fd) {
+            uint64_t expirations;
+            if (read(_timer_fd, &expirations, sizeof(expirations)) > 0) {
+                // overruns are coalesced into a single tick
+                _handle_tick();
+            }
+        } else if (fd == _wakeup_fds[0]) {
+            _drain_wakeup();
+        } else {
+            _dispatch_fd(fd);
+            
+            // a hung up fd stays readable forever, drop it once the handler has had what's left
+            if ((events[i].events & (EPOLLHUP | EPOLLERR)) && _handlers.count(fd) > 0) {
+                Logger::log_debug("Fd %d hung up.", fd);
+                remove_fd(fd);
+            }
+        }
+    }
+#else
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(_wakeup_fds[0], &fds);
+    int max_fd = _wakeup_fds[0];
+    for (auto pair : _handlers) {
+        FD_SET(pair.first, &fds);
+        max_fd = (pair.first > max_fd ? pair.first : max_fd);
+    }
+    
+    double timeout_secs = _next_tick_time - Util::current_time();
+    if (timeout_secs < 0.0) {
+        timeout_secs = 0.0;
+    }
+    struct timeval timeout;
+    timeout.tv_sec = (time_t) timeout_secs;
+    timeout.tv_usec = (suseconds_t) ((timeout_secs - timeout.tv_sec) * 1000000.0);
+    
+    int count = select(max_fd + 1, &fds, NULL, NULL, (_tick_handler ? &timeout : NULL));
+    if (count < 0) {
+        return;
+    }
+    
+    _count_wakeup();
+    if (FD_ISSET(_wakeup_fds[0], &fds)) {
+        _drain_wakeup();
+    }
+    auto handlers = _handlers; // handlers may remove themselves
+    for (auto pair : handlers) {
+        if (_running && FD_ISSET(pair.first, &fds)) {
+            _dispatch_fd(pair.first);
+        }
+    }
+    
+    double now = Util::current_time();
+    if (_running && _tick_handler && now >= _next_tick_time) {
+        // keep a fixed cadence, but don't try to catch up on missed ticks
+        _next_tick_time += 1.0 / _tick_rate;
+        if (_next_tick_time < now) {
+            _next_tick_time = now + 1.0 / _tick_rate;
+        }
+        _handle_tick();
+    }
+#endif
+}
+
+void EventLoop::_dispatch_fd(int fd)
+{
+    auto itr = _handlers.find(fd);
+    if (itr != _handlers.end()) {
+        EventHandler handler = itr->second;
+        handler();
+    }
+}
+
+void EventLoop::_handle_tick()
+{
+    if (_tick_handler) {
+        _tick_handler();
+    }
+}
+
+void EventLoop::_drain_wakeup()
+{
+    uint64_t value;
+    while (read(_wakeup_fds[0], &value, sizeof(value)) > 0);
+    
+    if (_wakeup_handler) {
+        _wakeup_handler();
+    }
+}
+
+void EventLoop::_count_wakeup()
+{
+    long second = (long) Util::current_time();
+    if (second != _wakeup_window) {
+        // publish the count for the last full second
+        _wakeup_rate = (second == _wakeup_window + 1 ? _wakeup_count : 0);
+        _wakeup_count = 0;
+        _wakeup_window = second;
+    }
+    
+    ++_wakeup_count;
+}
+
+} // namespace djpi
@@ -0,0 +1,60 @@
+/*
+ * event_loop.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <functional>
+#include <map>
+
+namespace djpi {
+
+typedef std::function<void()> EventHandler;
+
+class EventLoop {
+public:
+    EventLoop();
+    ~EventLoop();
+    
+    // registering event sources
+    void add_fd(int fd, EventHandler handler);
+    void remove_fd(int fd);
+    void set_tick(unsigned rate_hz, EventHandler handler);
+    void set_wakeup_handler(EventHandler handler);
+    
+    // running
+    void run();
+    void stop();
+    void wakeup(); // safe to call from any thread
+    
+    // statistics
+    unsigned get_tick_rate() const { return _tick_rate; }
+    unsigned get_wakeup_rate() const { return _wakeup_rate; }
+    
+private:
+    void _wait_for_events();
+    void _dispatch_fd(int fd);
+    void _handle_tick();
+    void _drain_wakeup();
+    void _count_wakeup();
+    
+protected:
+    int _poll_fd;
+    int _timer_fd;
+    int _wakeup_fds[2];
+    std::map<int, EventHandler> _handlers;
+    EventHandler _tick_handler;
+    EventHandler _wakeup_handler;
+    unsigned _tick_rate;
+    double _next_tick_time;
+    bool _running;
+    
+    unsigned _wakeup_count;
+    unsigned _wakeup_rate;
+    long _wakeup_window;
+};
+
+} // namespace djpi
@@ -0,0 +1,475 @@
+/*
+ * file_system.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "file_system.h"
+#include "io_ring.h"
+#include "io_scheduler.h"
+#include "logger.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <fcntl.h>
+#include <fmod/fmod_errors.h>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define WINDOW_SIZE         (1 << 20) // a multiple of the page size
+#define IO_RING_ENTRIES     64
+#define ASYNC_BLOCK_ALIGN   16384
+
+struct AsyncRead;
+
+struct OpenFile {
+    int fd;
+    size_t size;
+    size_t position;
+    char *window;
+    size_t window_offset;
+    size_t window_length;
+    size_t read_ahead_end;
+    std::shared_ptr<djpi::FileStats> stats;
+    std::vector<AsyncRead *> pending_reads; // guarded by __async_lock
+};
+
+struct AsyncRead {
+    FMOD_ASYNCREADINFO *info;
+    OpenFile *file;
+    unsigned int done;
+    djpi::IoScheduler::Class io_class;
+    double start_time;
+};
+
+static djpi::FileSystem::Mode __mode = djpi::FileSystem::Mode::FMOD;
+static std::mutex __tracked_files_lock;
+static std::map<std::string, std::weak_ptr<djpi::FileStats>> __tracked_files;
+
+static std::unique_ptr<djpi::IoRing> __ring;
+static std::mutex __async_lock;
+static std::condition_variable __async_done;
+
+static djpi::IoScheduler::Class __get_io_class(const std::shared_ptr<djpi::FileStats> &stats)
+{
+    // files nobody asked us to track are assumed to matter
+    return (stats && !stats->critical.load() ? djpi::IoScheduler::Class::BACKGROUND : djpi::IoScheduler::Class::CRITICAL);
+}
+
+static void __prefetch_pages(OpenFile *file, size_t offset, size_t length)
+{
+#ifdef POSIX_FADV_WILLNEED
+    posix_fadvise(file->fd, offset, length, POSIX_FADV_WILLNEED);
+#endif
+}
+
+static void __drop_pages(OpenFile *file, size_t offset, size_t length)
+{
+#ifdef POSIX_FADV_DONTNEED
+    posix_fadvise(file->fd, offset, length, POSIX_FADV_DONTNEED);
+#endif
+}
+
+static void __unmap_window(OpenFile *file)
+{
+    if (file->window) {
+        munmap(file->window, file->window_length);
+        file->window = nullptr;
+    }
+}
+
+static bool __move_window(OpenFile *file)
+{
+    // false if the position is still inside the current window
+    size_t window_end = file->window_offset + file->window_length;
+    if (file->window_length > 0 && file->position >= file->window_offset && file->position < window_end) {
+        return false;
+    }
+    
+    // moving forward, the window behind us won't be needed again any time soon
+    bool forward = (file->window_length > 0 && file->position >= window_end);
+    __unmap_window(file);
+    if (forward) {
+        __drop_pages(file, file->window_offset, file->window_length);
+    }
+    
+    file->window_offset = file->position & ~((size_t) WINDOW_SIZE - 1);
+    file->window_length = (file->window_offset < file->size ? std::min((size_t) WINDOW_SIZE, file->size - file->window_offset) : 0);
+    return true;
+}
+
+static bool __map_window(OpenFile *file)
+{
+    if (!__move_window(file) && file->window) {
+        return true;
+    }
+    
+    // touching a page past the end of a file that shrank raises SIGBUS, so check it's all still
+    // there. a file truncated after this can still take us down, which is why this is opt-in.
+    struct stat st;
+    if (fstat(file->fd, &st) != 0 || (size_t) st.st_size < file->window_offset + file->window_length) {
+        djpi::Logger::log_error("File changed size while it was being read.");
+        return false;
+    }
+    
+    // if memory is locked this faults the whole window in straight away, which the read ahead
+    // has usually already brought into the page cache
+    size_t offset = file->window_offset;
+    size_t length = file->window_length;
+    void *window = mmap(NULL, length, PROT_READ, MAP_SHARED, file->fd, offset);
+    if (window == MAP_FAILED) {
+        djpi::Logger::log_error("Unable to map file (%s).", strerror(errno));
+        return false;
+    }
+    madvise(window, length, MADV_SEQUENTIAL);
+    
+    file->window = (char *) window;
+    return true;
+}
+
+static void __read_ahead(OpenFile *file)
+{
+    // past the middle of the window, start the kernel reading the next one in the background
+    size_t window_end = file->window_offset + file->window_length;
+    if (file->position >= file->window_offset + file->window_length / 2 &&
+        window_end < file->size && file->read_ahead_end <= window_end)
+    {
+        file->read_ahead_end = std::min(window_end + WINDOW_SIZE, file->size);
+        __prefetch_pages(file, window_end, file->read_ahead_end - window_end);
+    }
+}
+
+static FMOD_RESULT F_CALLBACK __open_callback(const char *name, int unicode, unsigned int *filesize, void **handle, void **userdata)
+{
+    std::shared_ptr<djpi::FileStats> stats;
+    {
+        std::lock_guard<std::mutex> lock(__tracked_files_lock);
+        auto itr = __tracked_files.find(name);
+        if (itr != __tracked_files.end()) {
+            stats = itr->second.lock();
+        }
+    }
+    
+    // opens only ever happen on FMOD's loader thread or a decoder, so upcoming tracks can wait
+    djpi::IoScheduler::Class io_class = __get_io_class(stats);
+    if (io_class == djpi::IoScheduler::Class::BACKGROUND) {
+        djpi::IoScheduler::wait_for_turn();
+    }
+    double start_time = djpi::IoScheduler::begin(io_class);
+    
+    struct stat st;
+    int fd = open(name, O_RDONLY | O_CLOEXEC);
+    bool opened = (fd >= 0 && fstat(fd, &st) == 0);
+    djpi::IoScheduler::end(io_class, start_time);
+    
+    if (fd < 0) {
+        return FMOD_ERR_FILE_NOTFOUND;
+    } else if (!opened) {
+        close(fd);
+        return FMOD_ERR_FILE_BAD;
+    }
+    
+    OpenFile *file = new OpenFile;
+    file->fd = fd;
+    file->size = st.st_size;
+    file->position = 0;
+    file->window = nullptr;
+    file->window_offset = 0;
+    file->window_length = 0;
+    file->read_ahead_end = 0;
+    file->stats = stats;
+    
+    *filesize = (unsigned int) std::min(file->size, (size_t) 0xFFFFFFFF);
+    *handle = file;
+    *userdata = nullptr;
+    return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK __close_callback(void *handle, void *userdata)
+{
+    OpenFile *file = (OpenFile *) handle;
+    __unmap_window(file);
+    close(file->fd);
+    delete file;
+    return FMOD_OK;
+}
+
+static int __read_now(int fd, void *buffer, size_t length, size_t offset)
+{
+    size_t done = 0;
+    while (done < length) {
+        ssize_t result = pread(fd, (char *) buffer + done, length - done, offset + done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result < 0) {
+            return -errno;
+        } else if (result == 0) {
+            break;
+        }
+        done += result;
+    }
+    return (int) done;
+}
+
+static FMOD_RESULT F_CALLBACK __read_callback(void *handle, void *buffer, unsigned int sizebytes, unsigned int *bytesread, void *userdata)
+{
+    OpenFile *file = (OpenFile *) handle;
+    size_t length = (file->position < file->size ? std::min((size_t) sizebytes, file->size - file->position) : 0);
+    
+    // these can be on FMOD's stream thread, so they're only measured, never held back
+    djpi::IoScheduler::Class io_class = __get_io_class(file->stats);
+    double start_time = djpi::IoScheduler::begin(io_class);
+    
+    size_t copied = 0;
+    if (__mode == djpi::FileSystem::Mode::MMAP) {
+        while (copied < length) {
+            if (!__map_window(file)) {
+                djpi::IoScheduler::end(io_class, start_time);
+                *bytesread = (unsigned int) copied;
+                return FMOD_ERR_FILE_BAD;
+            }
+        
+            size_t window_position = file->position - file->window_offset;
+            size_t count = std::min(length - copied, file->window_length - window_position);
+            memcpy((char *) buffer + copied, file->window + window_position, count);
+            copied += count;
+            file->position += count;
+        }
+    } else if (length > 0) {
+        // a file that shrank or went away just comes up short or fails here
+        int result = __read_now(file->fd, buffer, length, file->position);
+        if (result < 0) {
+            djpi::IoScheduler::end(io_class, start_time);
+            *bytesread = 0;
+            return FMOD_ERR_FILE_BAD;
+        }
+        copied = result;
+        file->position += copied;
+        __move_window(file);
+    }
+    __read_ahead(file);
+    djpi::IoScheduler::end(io_class, start_time);
+    
+    if (file->stats) {
+        file->stats->bytes_read.fetch_add(copied, std::memory_order_relaxed);
+        file->stats->read_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    
+    *bytesread = (unsigned int) copied;
+    return (copied < sizebytes ? FMOD_ERR_FILE_EOF : FMOD_OK);
+}
+
+static FMOD_RESULT F_CALLBACK __seek_callback(void *handle, unsigned int pos, void *userdata)
+{
+    // a position the engine looked up itself replaces the one FMOD estimated from the bitrate
+    OpenFile *file = (OpenFile *) handle;
+    long long redirect = (file->stats ? file->stats->seek_redirect.exchange(-1) : -1);
+    file->position = (redirect >= 0 ? (size_t) redirect : pos);
+    return FMOD_OK;
+}
+
+static void __finish_async_read(AsyncRead *read, int result)
+{
+    FMOD_ASYNCREADINFO *info = read->info;
+    OpenFile *file = read->file;
+    if (result != -ECANCELED) {
+        if (file->stats) {
+            file->stats->bytes_read.fetch_add(read->done, std::memory_order_relaxed);
+            file->stats->read_count.fetch_add(1, std::memory_order_relaxed);
+        }
+        
+        // FMOD picks the data up the moment the result changes, so it has to be written last
+        info->bytesread = read->done;
+        std::atomic_thread_fence(std::memory_order_release);
+        info->result = (result < 0 ? FMOD_ERR_FILE_BAD : (read->done < info->sizebytes ? FMOD_ERR_FILE_EOF : FMOD_OK));
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(__async_lock);
+        file->pending_reads.erase(std::find(file->pending_reads.begin(), file->pending_reads.end(), read));
+        if (file->pending_reads.empty()) {
+            __async_done.notify_all();
+        }
+    }
+    delete read;
+}
+
+static void __complete_async_read(void *tag, int result)
+{
+    // called on the ring's thread
+    AsyncRead *read = (AsyncRead *) tag;
+    FMOD_ASYNCREADINFO *info = read->info;
+    if (result > 0) {
+        read->done += result;
+        
+        // a short read before the end of the file carries on from where it stopped
+        size_t offset = info->offset + read->done;
+        if (read->done < info->sizebytes && offset < read->file->size) {
+            void *buffer = (char *) info->buffer + read->done;
+            unsigned int length = info->sizebytes - read->done;
+            if (__ring->submit_read(read->file->fd, buffer, length, offset, read)) {
+                return;
+            }
+            
+            result = __read_now(read->file->fd, buffer, length, offset);
+            read->done += std::max(result, 0);
+        }
+    }
+    djpi::IoScheduler::end(read->io_class, read->start_time);
+    __finish_async_read(read, result);
+}
+
+static void __dispatch_async_read(AsyncRead *read)
+{
+    FMOD_ASYNCREADINFO *info = read->info;
+    if (!__ring->submit_read(read->file->fd, info->buffer, info->sizebytes, info->offset, read)) {
+        // the ring is full, read it here instead
+        int result = __read_now(read->file->fd, info->buffer, info->sizebytes, info->offset);
+        read->done = std::max(result, 0);
+        djpi::IoScheduler::end(read->io_class, read->start_time);
+        __finish_async_read(read, result);
+    }
+}
+
+static FMOD_RESULT F_CALLBACK __async_read_callback(FMOD_ASYNCREADINFO *info, void *userdata)
+{
+    OpenFile *file = (OpenFile *) info->handle;
+    AsyncRead *read = new AsyncRead;
+    read->info = info;
+    read->file = file;
+    read->done = 0;
+    read->start_time = djpi::Util::current_time();
+    
+    // FMOD flags reads it's about to starve without, even for a stream that isn't playing yet
+    read->io_class = __get_io_class(file->stats);
+    if (info->priority >= 100) {
+        read->io_class = djpi::IoScheduler::Class::CRITICAL;
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(__async_lock);
+        file->pending_reads.push_back(read);
+    }
+    
+    djpi::IoScheduler::submit(read->io_class, read, [read]() { __dispatch_async_read(read); });
+    return FMOD_OK;
+}
+
+static FMOD_RESULT F_CALLBACK __async_cancel_callback(void *handle, void *userdata)
+{
+    // FMOD frees the buffers once we return, so every read on the file has to have finished
+    OpenFile *file = (OpenFile *) handle;
+    std::vector<AsyncRead *> dropped_reads;
+    std::unique_lock<std::mutex> lock(__async_lock);
+    for (auto read : file->pending_reads) {
+        if (djpi::IoScheduler::cancel(read)) {
+            dropped_reads.push_back(read);
+        } else {
+            __ring->cancel(read);
+        }
+    }
+    
+    // reads still waiting in the scheduler never started, so they can be finished right here
+    lock.unlock();
+    for (auto read : dropped_reads) {
+        __finish_async_read(read, -ECANCELED);
+    }
+    lock.lock();
+    
+    __async_done.wait(lock, [file]() { return file->pending_reads.empty(); });
+    return FMOD_OK;
+}
+
+namespace djpi {
+
+bool FileSystem::install(FMOD::System *system, Mode mode)
+{
+    if (mode == Mode::URING) {
+        if (!__ring) {
+            __ring = std::unique_ptr<IoRing>(new IoRing(IO_RING_ENTRIES, __complete_async_read));
+        }
+        if (!__ring->is_available()) {
+            Logger::log_error("Warning: falling back to plain file reads.");
+            mode = Mode::PREAD;
+        }
+    }
+    
+    FMOD_RESULT result = FMOD_OK;
+    __mode = mode;
+    if (mode == Mode::URING) {
+        // anything FMOD still reads synchronously goes through pread
+        result = system->setFileSystem(__open_callback, __close_callback, __read_callback, __seek_callback,
+                                       __async_read_callback, __async_cancel_callback, ASYNC_BLOCK_ALIGN);
+    } else if (mode == Mode::PREAD || mode == Mode::MMAP) {
+        // no block alignment, reads go straight into FMOD's buffer so it needn't keep another
+        result = system->setFileSystem(__open_callback, __close_callback, __read_callback, __seek_callback, NULL, NULL, 0);
+    } else {
+        result = system->setFileSystem(NULL, NULL, NULL, NULL, NULL, NULL, 2048);
+    }
+    
+    if (result != FMOD_OK) {
+        Logger::log_error("FMOD Error %d: %s", result, FMOD_ErrorString(result));
+        __mode = Mode::FMOD;
+        return false;
+    }
+    return true;
+}
+
+FileSystem::Mode FileSystem::get_mode()
+{
+    return __mode;
+}
+
+bool FileSystem::can_redirect_seeks()
+{
+    // asynchronous reads come with their own offsets and never go through a seek
+    return (__mode == Mode::PREAD || __mode == Mode::MMAP);
+}
+
+bool FileSystem::parse_mode(const std::string &name, Mode &mode_out)
+{
+    if (name == "fmod") {
+        mode_out = Mode::FMOD;
+    } else if (name == "pread") {
+        mode_out = Mode::PREAD;
+    } else if (name == "mmap") {
+        mode_out = Mode::MMAP;
+    } else if (name == "uring") {
+        mode_out = Mode::URING;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+std::shared_ptr<FileStats> FileSystem::track_file(const std::string &filename)
+{
+    std::lock_guard<std::mutex> lock(__tracked_files_lock);
+    
+    // forget files nobody is holding counters for any more
+    auto itr = __tracked_files.begin();
+    while (itr != __tracked_files.end()) {
+        if (itr->second.expired()) {
+            itr = __tracked_files.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+    
+    std::shared_ptr<FileStats> stats = __tracked_files[filename].lock();
+    if (!stats) {
+        stats = std::shared_ptr<FileStats>(new FileStats);
+        __tracked_files[filename] = stats;
+    }
+    return stats;
+}
+
+} // namespace djpi
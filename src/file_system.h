@@ -0,0 +1,49 @@
+/*
+ * file_system.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <atomic>
+#include <fmod/fmod.hpp>
+#include <memory>
+#include <string>
+
+namespace djpi {
+
+struct FileStats {
+    FileStats() : bytes_read(0), read_count(0), critical(false), seek_redirect(-1) {}
+    
+    std::atomic<unsigned long long> bytes_read;
+    std::atomic<size_t> read_count;
+    std::atomic<bool> critical; // playback depends on it, otherwise reads are background work
+    std::atomic<long long> seek_redirect; // the next seek on the file lands here instead, -1 for none. see can_redirect_seeks().
+};
+
+// The file callbacks FMOD reads every track through. Files are paced a window at a time,
+// with the next window read ahead of the stream and the one behind it dropped from the page
+// cache, so even huge FLACs never crowd out the cache. With the io_uring, reads for every
+// open stream are in flight at once instead of queueing up behind each other on FMOD's
+// stream thread.
+class FileSystem {
+public:
+    enum class Mode {
+        FMOD, // FMOD's own buffered reads
+        PREAD,
+        MMAP, // copies out of mapped windows. a file truncated or a card pulled mid-read kills the process with SIGBUS
+        URING // FMOD's asynchronous reads, queued on an io_uring shared by every open file
+    };
+    
+    static bool install(FMOD::System *system, Mode mode); // before any sounds are opened
+    static Mode get_mode();
+    static bool can_redirect_seeks(); // whether FMOD's seeks go through our seek callback
+    static bool parse_mode(const std::string &name, Mode &mode_out);
+    
+    // every open of the file adds to the returned counters for as long as they're held
+    static std::shared_ptr<FileStats> track_file(const std::string &filename);
+};
+
+} // namespace djpi
@@ -0,0 +1,171 @@
+/*
+ * head_cache.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "head_cache.h"
+#include "file_system.h"
+#include "io_scheduler.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <fmod/fmod_errors.h>
+
+namespace djpi {
+
+HeadCache::HeadCache(FMOD::System *system, size_t head_size) :
+    _system(system),
+    _head_size(head_size),
+    _running(true),
+    _hits(0),
+    _misses(0)
+{
+    _thread = std::thread(&HeadCache::_worker_main, this);
+}
+
+HeadCache::~HeadCache()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _running.store(false);
+    }
+    _cond.notify_all();
+    _thread.join();
+}
+
+void HeadCache::set_window(const std::vector<HeadRequest> &tracks)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    _window = tracks;
+    
+    auto itr = _heads.begin();
+    while (itr != _heads.end()) {
+        if (!_is_wanted(itr->first)) {
+            itr = _heads.erase(itr);
+        } else {
+            ++itr;
+        }
+    }
+    _cond.notify_all();
+}
+
+std::shared_ptr<const TrackHead> HeadCache::find(TrackHandle handle)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    auto itr = _heads.find(handle);
+    if (itr != _heads.end() && itr->second) {
+        ++_hits;
+        return itr->second;
+    }
+    
+    ++_misses;
+    return nullptr;
+}
+
+HeadCacheStats HeadCache::get_stats()
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    HeadCacheStats stats;
+    stats.head_count = 0;
+    stats.bytes = 0;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    for (auto &entry : _heads) {
+        if (entry.second) {
+            ++stats.head_count;
+            stats.bytes += entry.second->data.size();
+        }
+    }
+    return stats;
+}
+
+#pragma mark - Internal
+
+void HeadCache::_worker_main()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    while (_running.load()) {
+        // the nearest track in the window that hasn't been tried yet
+        auto next = std::find_if(_window.begin(), _window.end(), [this](const HeadRequest &track) {
+            return _heads.count(track.handle) == 0;
+        });
+        if (next == _window.end()) {
+            _cond.wait(lock);
+            continue;
+        }
+        
+        HeadRequest request = *next;
+        lock.unlock();
+        
+        IoScheduler::wait_for_turn();
+        std::shared_ptr<const TrackHead> head = _decode_head(request);
+        
+        // the cursor may have moved on while we were decoding
+        lock.lock();
+        if (_is_wanted(request.handle)) {
+            _heads[request.handle] = head;
+        }
+    }
+}
+
+std::shared_ptr<const TrackHead> HeadCache::_decode_head(const HeadRequest &request)
+{
+    const std::string &filename = request.filename;
+    
+    // reads for it are background work, playback takes priority
+    std::shared_ptr<FileStats> file_stats;
+    if (FileSystem::get_mode() != FileSystem::Mode::FMOD) {
+        file_stats = FileSystem::track_file(filename);
+    }
+    
+    FMOD::Sound *source = nullptr;
+    FMOD_RESULT result = _system->createSound(filename.c_str(), FMOD_OPENONLY | FMOD_CREATESTREAM, NULL, &source);
+    if (result != FMOD_OK) {
+        Logger::log_debug("Unable to cache the start of %s: %s", filename.c_str(), FMOD_ErrorString(result));
+        return nullptr;
+    }
+    
+    std::shared_ptr<TrackHead> head(new TrackHead);
+    int bits = 0;
+    source->getFormat(NULL, &head->format, &head->channels, &bits);
+    source->getDefaults(&head->frequency, NULL, NULL, NULL);
+    head->frame_size = head->channels * bits / 8;
+    
+    // FMOD's length is only an estimate for VBR files, see PCMStream::_read_format()
+    unsigned int estimate = 0;
+    source->getLength(&estimate, FMOD_TIMEUNIT_PCMBYTES);
+    if (head->frame_size <= 0 || head->frequency <= 0.f || estimate == 0 || estimate == 0xFFFFFFFF) {
+        source->release();
+        return nullptr;
+    }
+    head->length = (request.length_ms > 0 ? PCMStream::get_pcm_length(request.length_ms, head->frequency, head->frame_size) : 0);
+    
+    head->data.resize(_head_size - _head_size % head->frame_size);
+    size_t filled = 0;
+    while (filled < head->data.size() && _running.load()) {
+        unsigned int read = 0;
+        result = source->readData(&head->data[filled], (unsigned int) (head->data.size() - filled), &read);
+        filled += read;
+        if (result != FMOD_OK) {
+            break;
+        }
+    }
+    source->release();
+    
+    head->data.resize(filled - filled % head->frame_size);
+    return (head->data.empty() ? nullptr : head);
+}
+
+bool HeadCache::_is_wanted(TrackHandle handle) const
+{
+    for (auto &track : _window) {
+        if (track.handle == handle) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace djpi
@@ -0,0 +1,70 @@
+/*
+ * head_cache.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <fmod/fmod.hpp>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "pcm_stream.h"
+#include "track_table.h"
+
+namespace djpi {
+
+// A track the cache should hold the start of.
+struct HeadRequest {
+    TrackHandle handle;
+    std::string filename;
+    unsigned int length_ms; // from the seek index, 0 if not known exactly
+};
+
+struct HeadCacheStats {
+    size_t head_count;
+    size_t bytes;
+    size_t hits;
+    size_t misses;
+};
+
+// The start of every track near the cursor, decoded on a background thread so skipping to
+// any of them can start playing from memory while the rest of the track opens behind it.
+class HeadCache {
+public:
+    HeadCache(FMOD::System *system, size_t head_size); // head_size is bytes of PCM per track
+    ~HeadCache();
+    
+    // engine thread. the tracks to keep heads for, nearest first, anything else is dropped.
+    void set_window(const std::vector<HeadRequest> &tracks);
+    std::shared_ptr<const TrackHead> find(TrackHandle handle);
+    
+    HeadCacheStats get_stats();
+
+private:
+    void _worker_main();
+    std::shared_ptr<const TrackHead> _decode_head(const HeadRequest &request);
+    bool _is_wanted(TrackHandle handle) const;
+
+protected:
+    FMOD::System *_system;
+    size_t _head_size;
+    std::thread _thread;
+    std::atomic<bool> _running;
+    
+    std::mutex _lock;
+    std::condition_variable _cond;
+    std::vector<HeadRequest> _window;
+    std::map<TrackHandle, std::shared_ptr<const TrackHead>> _heads; // null for tracks that couldn't be decoded
+    size_t _hits;
+    size_t _misses;
+};
+
+} // namespace djpi
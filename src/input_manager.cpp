@@ -7,12 +7,14 @@
  
 #include "input_manager.h"
 #include <cassert>
+#include <cerrno>
 #include <cstring>
 #include <sys/select.h>
 #include <termios.h>
 #include <unistd.h>
 
 #define MAX_EVENT_QUEUE_SIZE    100
+#define INPUT_BUFFER_SIZE       32
 
 static bool __terminal_configured = false;
 static struct termios __original_opts;
@@ -35,7 +37,7 @@ InputManager::~InputManager()
 
 #pragma mark - Updating
 
-void InputManager::update(time_t time)
+bool InputManager::update(time_t time)
 {
     struct timeval timeout = {0};
     fd_set fds;
@@ -43,13 +45,26 @@ void InputManager::update(time_t time)
     FD_SET(STDIN_FILENO, &fds);
     
     int ready = select(1, &fds, NULL, NULL, &timeout);
-    if (ready) {
-        unsigned char c;
-        read(STDIN_FILENO, &c, sizeof(c));
+    if (ready > 0) {
+        // consume everything that's pending so one wakeup handles a whole escape sequence
+        unsigned char buf[INPUT_BUFFER_SIZE];
+        ssize_t count = read(STDIN_FILENO, buf, sizeof(buf));
+        for (ssize_t i = 0; i < count; ++i) {
+            KeyEvent e = { buf[i], time };
+            _enqueue_event(e);
+        }
         
-        KeyEvent e = { c, time };
-        _enqueue_event(e);
+        // end of file, or the terminal went away
+        if (count == 0 || (count < 0 && errno != EAGAIN && errno != EINTR)) {
+            return false;
+        }
     }
+    return true;
+}
+
+int InputManager::get_fd() const
+{
+    return STDIN_FILENO;
 }
 
 #pragma mark - Polling the Event Queue
@@ -24,7 +24,8 @@ public:
     ~InputManager();
     
     // update
-    void update(time_t time);
+    bool update(time_t time); // false once input has closed
+    int get_fd() const;
     
     // polling the event queue
     bool poll_event(KeyEvent *event_out);
@@ -0,0 +1,279 @@
+/*
+ * io_ring.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "io_ring.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+
+// headers old enough not to have probing don't have IORING_OP_READ either
+#if defined(__linux__) && defined(__NR_io_uring_setup) && defined(IO_URING_OP_SUPPORTED)
+#define HAS_IO_URING 1
+#endif
+
+#define PROBE_OP_COUNT  64
+
+#ifdef HAS_IO_URING
+static int __io_uring_setup(unsigned entries, struct io_uring_params *params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int __io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static bool __supports_ops(int fd, const unsigned char *ops, size_t count)
+{
+    // 5.1 to 5.5 set up a ring fine but fail every IORING_OP_READ in its completion. probing
+    // came in with the same kernel as the opcode, so a kernel that can't be probed can't read.
+    size_t size = sizeof(struct io_uring_probe) + PROBE_OP_COUNT * sizeof(struct io_uring_probe_op);
+    std::vector<char> buffer(size, 0);
+    struct io_uring_probe *probe = (struct io_uring_probe *) buffer.data();
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, PROBE_OP_COUNT) < 0) {
+        return false;
+    }
+    
+    for (size_t i = 0; i < count; ++i) {
+        if (ops[i] >= probe->ops_len || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+namespace djpi {
+
+IoRing::IoRing(unsigned entries, CompletionHandler handler) :
+    _ring_fd(-1),
+    _handler(handler),
+    _running(false),
+    _in_flight(0),
+    _sq_ring(nullptr),
+    _sq_ring_size(0),
+    _cq_ring(nullptr),
+    _cq_ring_size(0),
+    _sqes(nullptr),
+    _sqes_size(0),
+    _sq_head(nullptr),
+    _sq_tail(nullptr),
+    _sq_array(nullptr),
+    _sq_mask(0),
+    _sq_entries(0),
+    _cq_head(nullptr),
+    _cq_tail(nullptr),
+    _cqes(nullptr),
+    _cq_mask(0),
+    _cq_entries(0)
+{
+    if (_setup(entries)) {
+        _running.store(true);
+        _thread = std::thread(&IoRing::_thread_main, this);
+    }
+}
+
+IoRing::~IoRing()
+{
+    if (_thread.joinable()) {
+        // a no-op with no tag wakes the completion thread so it sees we're stopping
+        _running.store(false);
+        while (!_submit(0, -1, nullptr, 0, 0, nullptr) && _in_flight.load() > 0) {
+            std::this_thread::yield();
+        }
+        _thread.join();
+    }
+    
+    if (_sqes) {
+        munmap(_sqes, _sqes_size);
+    }
+    if (_cq_ring && _cq_ring != _sq_ring) {
+        munmap(_cq_ring, _cq_ring_size);
+    }
+    if (_sq_ring) {
+        munmap(_sq_ring, _sq_ring_size);
+    }
+    if (_ring_fd >= 0) {
+        close(_ring_fd);
+    }
+}
+
+#pragma mark - Submitting
+
+bool IoRing::submit_read(int fd, void *buffer, unsigned length, unsigned long long offset, void *tag)
+{
+#ifdef HAS_IO_URING
+    return _submit(IORING_OP_READ, fd, buffer, length, offset, tag);
+#else
+    return false;
+#endif
+}
+
+void IoRing::cancel(void *tag)
+{
+#ifdef HAS_IO_URING
+    // the cancel request's own completion has no tag and is ignored
+    _submit(IORING_OP_ASYNC_CANCEL, -1, tag, 0, 0, nullptr);
+#endif
+}
+
+#pragma mark - Internal
+
+bool IoRing::_setup(unsigned entries)
+{
+#ifdef HAS_IO_URING
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    _ring_fd = __io_uring_setup(entries, &params);
+    if (_ring_fd < 0) {
+        Logger::log_error("Warning: io_uring isn't available (%s).", strerror(errno));
+        return false;
+    }
+    
+    static const unsigned char __required_ops[] = {IORING_OP_NOP, IORING_OP_READ, IORING_OP_ASYNC_CANCEL};
+    if (!__supports_ops(_ring_fd, __required_ops, sizeof(__required_ops))) {
+        Logger::log_error("Warning: this kernel's io_uring can't do plain reads.");
+        close(_ring_fd);
+        _ring_fd = -1;
+        return false;
+    }
+    
+    // newer kernels share one mapping between both rings
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    _cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap) {
+        _sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+    }
+    
+    _sq_ring = mmap(NULL, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED) {
+        _sq_ring = nullptr;
+    } else if (single_mmap) {
+        _cq_ring = _sq_ring;
+    } else {
+        _cq_ring = mmap(NULL, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_CQ_RING);
+        _cq_ring = (_cq_ring == MAP_FAILED ? nullptr : _cq_ring);
+    }
+    
+    _sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    _sqes = mmap(NULL, _sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _ring_fd, IORING_OFF_SQES);
+    _sqes = (_sqes == MAP_FAILED ? nullptr : _sqes);
+    
+    if (!_sq_ring || !_cq_ring || !_sqes) {
+        Logger::log_error("Warning: couldn't map the io_uring (%s).", strerror(errno));
+        close(_ring_fd);
+        _ring_fd = -1;
+        return false;
+    }
+    
+    char *sq = (char *) _sq_ring;
+    _sq_head = (unsigned *) (sq + params.sq_off.head);
+    _sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    _sq_array = (unsigned *) (sq + params.sq_off.array);
+    _sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    _sq_entries = params.sq_entries;
+    
+    char *cq = (char *) _cq_ring;
+    _cq_head = (unsigned *) (cq + params.cq_off.head);
+    _cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    _cqes = cq + params.cq_off.cqes;
+    _cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    _cq_entries = params.cq_entries;
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool IoRing::_submit(unsigned char opcode, int fd, void *buffer, unsigned length, unsigned long long offset, void *tag)
+{
+#ifdef HAS_IO_URING
+    if (_ring_fd < 0) {
+        return false;
+    }
+    
+    std::lock_guard<std::mutex> lock(_submit_lock);
+    
+    // never have more out than the completion queue can hold, or results would overflow it
+    unsigned tail = *_sq_tail;
+    unsigned head = __atomic_load_n(_sq_head, __ATOMIC_ACQUIRE);
+    if (tail - head >= _sq_entries || _in_flight.load() >= _cq_entries) {
+        return false;
+    }
+    
+    unsigned index = tail & _sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *) _sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->off = offset;
+    sqe->addr = (unsigned long long) (uintptr_t) buffer;
+    sqe->len = length;
+    sqe->user_data = (unsigned long long) (uintptr_t) tag;
+    _sq_array[index] = index;
+    
+    __atomic_store_n(_sq_tail, tail + 1, __ATOMIC_RELEASE);
+    _in_flight.fetch_add(1);
+    
+    int result;
+    do {
+        result = __io_uring_enter(_ring_fd, 1, 0, 0);
+    } while (result < 0 && errno == EINTR);
+    
+    if (result < 0) {
+        // the kernel never took it, so take it back out of the queue
+        __atomic_store_n(_sq_tail, tail, __ATOMIC_RELEASE);
+        _in_flight.fetch_sub(1);
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void IoRing::_thread_main()
+{
+#ifdef HAS_IO_URING
+    while (_running.load()) {
+        int result = __io_uring_enter(_ring_fd, 0, 1, IORING_ENTER_GETEVENTS);
+        if (result < 0 && errno != EINTR) {
+            Logger::log_error("io_uring wait failed (%s).", strerror(errno));
+            break;
+        }
+        
+        unsigned head = *_cq_head;
+        unsigned tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = (struct io_uring_cqe *) _cqes + (head & _cq_mask);
+            void *tag = (void *) (uintptr_t) cqe->user_data;
+            int res = cqe->res;
+            
+            __atomic_store_n(_cq_head, ++head, __ATOMIC_RELEASE);
+            _in_flight.fetch_sub(1);
+            if (tag) {
+                _handler(tag, res);
+            }
+        }
+    }
+#endif
+}
+
+} // namespace djpi
@@ -0,0 +1,64 @@
+/*
+ * io_ring.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace djpi {
+
+// A single io_uring driven straight through the system calls. Reads can be queued from any
+// thread, and their results are handed to the completion handler on the ring's own thread.
+class IoRing {
+public:
+    typedef std::function<void(void *tag, int result)> CompletionHandler; // result is bytes read or -errno
+    
+    IoRing(unsigned entries, CompletionHandler handler);
+    ~IoRing();
+    
+    bool is_available() const { return _ring_fd >= 0; }
+    
+    // false if the ring is full or unavailable, the caller should read synchronously instead
+    bool submit_read(int fd, void *buffer, unsigned length, unsigned long long offset, void *tag);
+    void cancel(void *tag); // the read still completes, with -ECANCELED if it hadn't started
+
+private:
+    bool _setup(unsigned entries);
+    bool _submit(unsigned char opcode, int fd, void *buffer, unsigned length, unsigned long long offset, void *tag);
+    void _thread_main();
+
+protected:
+    int _ring_fd;
+    CompletionHandler _handler;
+    std::mutex _submit_lock;
+    std::thread _thread;
+    std::atomic<bool> _running;
+    std::atomic<unsigned> _in_flight;
+    
+    // shared with the kernel
+    void *_sq_ring;
+    size_t _sq_ring_size;
+    void *_cq_ring;
+    size_t _cq_ring_size;
+    void *_sqes;
+    size_t _sqes_size;
+    unsigned *_sq_head;
+    unsigned *_sq_tail;
+    unsigned *_sq_array;
+    unsigned _sq_mask;
+    unsigned _sq_entries;
+    unsigned *_cq_head;
+    unsigned *_cq_tail;
+    void *_cqes;
+    unsigned _cq_mask;
+    unsigned _cq_entries;
+};
+
+} // namespace djpi
@@ -0,0 +1,250 @@
+/*
+ * io_scheduler.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "io_scheduler.h"
+#include "util.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#define THROTTLE_LEVEL              0.3f    // playback buffer fill below which background work stops
+#define BACKGROUND_MAX_IN_FLIGHT    2
+#define BACKGROUND_MAX_WAIT_MS      500     // nothing is held back longer than this
+#define DISPATCH_POLL_MS            20      // only while background reads are queued
+#define LATENCY_BUCKETS             24      // powers of two of microseconds, up to ~16s
+
+struct IoClassState {
+    IoClassState() : in_flight(0), completed(0)
+    {
+        for (auto &bucket : latency_buckets) {
+            bucket.store(0);
+        }
+    }
+    
+    std::atomic<size_t> in_flight;
+    std::atomic<size_t> completed;
+    std::atomic<size_t> latency_buckets[LATENCY_BUCKETS];
+};
+
+struct QueuedRead {
+    void *tag;
+    std::function<void()> dispatch;
+    double queued_time;
+};
+
+struct SchedulerState {
+    SchedulerState() : playback_buffer(1.f), stopping(false) {}
+    
+    IoClassState classes[2];
+    std::atomic<float> playback_buffer;
+    
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<QueuedRead> queue; // background only, critical reads never wait
+    std::thread dispatcher; // started by the first read that has to wait
+    bool stopping;
+};
+
+static SchedulerState& __get_state()
+{
+    // leaked so reads still in flight at exit can finish against it
+    static SchedulerState *__state = new SchedulerState;
+    return *__state;
+}
+
+static IoClassState& __get_class(djpi::IoScheduler::Class io_class)
+{
+    return __get_state().classes[io_class == djpi::IoScheduler::Class::CRITICAL ? 0 : 1];
+}
+
+static bool __background_may_go()
+{
+    SchedulerState &state = __get_state();
+    return (__get_class(djpi::IoScheduler::Class::CRITICAL).in_flight.load() == 0 &&
+            __get_class(djpi::IoScheduler::Class::BACKGROUND).in_flight.load() < BACKGROUND_MAX_IN_FLIGHT &&
+            state.playback_buffer.load() >= THROTTLE_LEVEL);
+}
+
+static void __dispatcher_main()
+{
+    // hands queued background reads out as soon as they're allowed, or once they've waited too long
+    SchedulerState &state = __get_state();
+    std::unique_lock<std::mutex> lock(state.lock);
+    while (!state.stopping || !state.queue.empty()) {
+        // with nothing queued, sleep until submit() or shutdown(). otherwise keep checking, since
+        // the playback buffer level is only ever stored, never signalled.
+        if (state.queue.empty()) {
+            state.cond.wait(lock);
+        } else {
+            state.cond.wait_for(lock, std::chrono::milliseconds(DISPATCH_POLL_MS));
+        }
+        
+        while (!state.queue.empty()) {
+            bool overdue = (djpi::Util::current_time() - state.queue.front().queued_time) * 1000.0 >= BACKGROUND_MAX_WAIT_MS;
+            if (!overdue && !state.stopping && !__background_may_go()) {
+                break;
+            }
+            
+            std::function<void()> dispatch = std::move(state.queue.front().dispatch);
+            state.queue.pop_front();
+            __get_class(djpi::IoScheduler::Class::BACKGROUND).in_flight.fetch_add(1);
+            
+            lock.unlock();
+            dispatch();
+            lock.lock();
+        }
+    }
+}
+
+static double __get_percentile(const IoClassState &state, double percentile)
+{
+    size_t counts[LATENCY_BUCKETS];
+    size_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        counts[i] = state.latency_buckets[i].load();
+        total += counts[i];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    
+    // report the top of the bucket the percentile falls into
+    size_t target = (size_t) (total * percentile);
+    size_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+        seen += counts[i];
+        if (seen > target) {
+            return (double) (2ULL << i) / 1000.0;
+        }
+    }
+    return (double) (2ULL << (LATENCY_BUCKETS - 1)) / 1000.0;
+}
+
+namespace djpi {
+
+void IoScheduler::submit(Class io_class, void *tag, std::function<void()> dispatch)
+{
+    if (io_class == Class::BACKGROUND) {
+        SchedulerState &state = __get_state();
+        std::unique_lock<std::mutex> lock(state.lock);
+        if (!state.stopping && (!state.queue.empty() || !__background_may_go())) {
+            QueuedRead read;
+            read.tag = tag;
+            read.dispatch = std::move(dispatch);
+            read.queued_time = Util::current_time();
+            state.queue.push_back(std::move(read));
+            
+            if (!state.dispatcher.joinable()) {
+                state.dispatcher = std::thread(__dispatcher_main);
+            }
+            state.cond.notify_all();
+            return;
+        }
+    }
+    
+    __get_class(io_class).in_flight.fetch_add(1);
+    dispatch();
+}
+
+bool IoScheduler::cancel(void *tag)
+{
+    SchedulerState &state = __get_state();
+    std::lock_guard<std::mutex> lock(state.lock);
+    for (auto itr = state.queue.begin(); itr != state.queue.end(); ++itr) {
+        if (itr->tag == tag) {
+            state.queue.erase(itr);
+            return true;
+        }
+    }
+    return false;
+}
+
+void IoScheduler::wait_for_turn()
+{
+    SchedulerState &state = __get_state();
+    double start = Util::current_time();
+    
+    std::unique_lock<std::mutex> lock(state.lock);
+    while (!__background_may_go() && (Util::current_time() - start) * 1000.0 < BACKGROUND_MAX_WAIT_MS) {
+        state.cond.wait_for(lock, std::chrono::milliseconds(DISPATCH_POLL_MS));
+    }
+}
+
+double IoScheduler::begin(Class io_class)
+{
+    __get_class(io_class).in_flight.fetch_add(1);
+    return Util::current_time();
+}
+
+void IoScheduler::end(Class io_class, double start_time)
+{
+    IoClassState &state = __get_class(io_class);
+    state.in_flight.fetch_sub(1);
+    state.completed.fetch_add(1);
+    
+    double micros = (Util::current_time() - start_time) * 1000000.0;
+    int bucket = 0;
+    while (bucket < LATENCY_BUCKETS - 1 && micros >= (double) (2ULL << bucket)) {
+        ++bucket;
+    }
+    state.latency_buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    
+    // something waiting may be allowed to go now
+    __get_state().cond.notify_all();
+}
+
+void IoScheduler::set_playback_buffer(float level)
+{
+    // only an atomic store, waiters poll for it rather than the engine taking the lock
+    __get_state().playback_buffer.store(level);
+}
+
+bool IoScheduler::is_throttled()
+{
+    return __get_state().playback_buffer.load() < THROTTLE_LEVEL;
+}
+
+IoStats IoScheduler::get_stats(Class io_class)
+{
+    IoClassState &class_state = __get_class(io_class);
+    IoStats stats;
+    stats.queued = 0;
+    if (io_class == Class::BACKGROUND) {
+        SchedulerState &state = __get_state();
+        std::lock_guard<std::mutex> lock(state.lock);
+        stats.queued = state.queue.size();
+    }
+    stats.in_flight = class_state.in_flight.load();
+    stats.completed = class_state.completed.load();
+    stats.latency_p50 = __get_percentile(class_state, 0.50);
+    stats.latency_p95 = __get_percentile(class_state, 0.95);
+    stats.latency_p99 = __get_percentile(class_state, 0.99);
+    return stats;
+}
+
+void IoScheduler::shutdown()
+{
+    // whatever is still queued is sent out on the way down
+    SchedulerState &state = __get_state();
+    std::thread dispatcher;
+    {
+        std::lock_guard<std::mutex> lock(state.lock);
+        state.stopping = true;
+        dispatcher = std::move(state.dispatcher);
+    }
+    state.cond.notify_all();
+    if (dispatcher.joinable()) {
+        dispatcher.join();
+    }
+}
+
+} // namespace djpi
@@ -0,0 +1,56 @@
+/*
+ * io_scheduler.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace djpi {
+
+struct IoStats {
+    size_t queued; // waiting for their turn
+    size_t in_flight;
+    size_t completed;
+    double latency_p50; // milliseconds, from being requested to completing
+    double latency_p95;
+    double latency_p99;
+};
+
+// Decides the order reads hit the card in. Playback-critical reads always go straight out,
+// background work (scanning, opening upcoming tracks) waits while critical reads are in
+// flight, and is held back entirely while the playing stream's buffer is running low.
+class IoScheduler {
+public:
+    enum class Class {
+        CRITICAL,
+        BACKGROUND
+    };
+    
+    // asynchronous reads, dispatched now or queued until their class may go. finish them with
+    // end() given the time they were submitted.
+    static void submit(Class io_class, void *tag, std::function<void()> dispatch);
+    static bool cancel(void *tag); // drops a queued read, false if it was already dispatched
+    
+    // for background threads that are free to block, returns once they may go or have waited long enough
+    static void wait_for_turn();
+    
+    // every request is bracketed by these, begin() returns the time to pass to end()
+    static double begin(Class io_class);
+    static void end(Class io_class, double start_time);
+    
+    // fed from the engine, 0.0 - 1.0
+    static void set_playback_buffer(float level);
+    static bool is_throttled();
+    
+    static IoStats get_stats(Class io_class);
+    
+    // stops the dispatcher thread, anything submitted after this goes straight out
+    static void shutdown();
+};
+
+} // namespace djpi
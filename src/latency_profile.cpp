@@ -0,0 +1,59 @@
+/*
+ * latency_profile.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "latency_profile.h"
+
+static const djpi::LatencyProfile __profiles[] = {
+    // small mix blocks for DJing live, at the cost of waking up every few milliseconds
+    {"live",        48000,  256,    2,  64 * 1024,  8,  FMOD_DSP_RESAMPLER_LINEAR},
+    
+    // FMOD's own mixer defaults, with a stream buffer big enough to ride out SD card stalls
+    {"balanced",    48000,  1024,   4,  128 * 1024, 16, FMOD_DSP_RESAMPLER_LINEAR},
+    
+    // long blocks and large reads so the CPU and card sleep as much as possible. most tracks
+    // are 44.1kHz, so mixing at that rate means they aren't resampled at all.
+    {"low-power",   44100,  2048,   4,  512 * 1024, 4,  FMOD_DSP_RESAMPLER_NOINTERP}
+};
+static const int __num_profiles = sizeof(__profiles) / sizeof(__profiles[0]);
+
+#define DEFAULT_PROFILE 1
+
+namespace djpi {
+
+double LatencyProfile::get_output_latency() const
+{
+    return (double) dsp_buffer_length * dsp_buffer_count * 1000.0 / sample_rate;
+}
+
+const LatencyProfile* LatencyProfile::find(const std::string &name)
+{
+    for (int i = 0; i < __num_profiles; ++i) {
+        if (name == __profiles[i].name) {
+            return &__profiles[i];
+        }
+    }
+    return nullptr;
+}
+
+const LatencyProfile& LatencyProfile::get_default()
+{
+    return __profiles[DEFAULT_PROFILE];
+}
+
+std::string LatencyProfile::get_names()
+{
+    std::string names;
+    for (int i = 0; i < __num_profiles; ++i) {
+        if (i > 0) {
+            names += ", ";
+        }
+        names += __profiles[i].name;
+    }
+    return names;
+}
+
+} // namespace djpi
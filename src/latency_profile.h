@@ -0,0 +1,32 @@
+/*
+ * latency_profile.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <fmod/fmod.hpp>
+#include <string>
+
+namespace djpi {
+
+// How the mixer and streams are sized, trading output latency against CPU wakeups and power.
+struct LatencyProfile {
+    const char *name;
+    int sample_rate;
+    unsigned dsp_buffer_length; // samples mixed per block
+    int dsp_buffer_count;
+    unsigned stream_buffer_size; // bytes of file data each stream keeps ahead
+    int software_channels; // voices the mixer will run
+    FMOD_DSP_RESAMPLER resampler;
+    
+    double get_output_latency() const; // milliseconds
+    
+    static const LatencyProfile* find(const std::string &name); // nullptr if there's no such profile
+    static const LatencyProfile& get_default();
+    static std::string get_names(); // for help text
+};
+
+} // namespace djpi
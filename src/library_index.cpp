@@ -0,0 +1,333 @@
+/*
+ * library_index.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "library_index.h"
+#include "logger.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <map>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC     0x58494A44 // "DJIX"
+#define INDEX_VERSION   4
+#define NO_STRING       0xFFFFFFFF
+
+namespace djpi {
+
+LibraryIndex::LibraryIndex() :
+    _mapping(nullptr),
+    _mapping_size(0),
+    _header(nullptr),
+    _directories(nullptr),
+    _entries(nullptr),
+    _subdirs(nullptr),
+    _strings(nullptr)
+{}
+
+LibraryIndex::~LibraryIndex()
+{
+    close();
+}
+
+#pragma mark - Opening
+
+bool LibraryIndex::open(std::string filename)
+{
+    close();
+    
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    
+    struct stat s;
+    if (fstat(fd, &s) != 0 || (size_t) s.st_size < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+    
+    void *mapping = mmap(NULL, s.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+    
+    _mapping = mapping;
+    _mapping_size = s.st_size;
+    _header = (const Header *) mapping;
+    
+    if (!_validate()) {
+        Logger::log_error("Warning: ignoring invalid library index %s.", filename.c_str());
+        close();
+        return false;
+    }
+    
+    const char *base = (const char *) mapping;
+    _directories = (const Directory *) (base + sizeof(Header));
+    _entries = (const Entry *) (_directories + _header->directory_count);
+    _subdirs = (const uint32_t *) (_entries + _header->entry_count);
+    _strings = (const char *) (_subdirs + _header->subdir_count);
+    
+    return true;
+}
+
+void LibraryIndex::close()
+{
+    if (_mapping) {
+        munmap(_mapping, _mapping_size);
+    }
+    
+    _mapping = nullptr;
+    _mapping_size = 0;
+    _header = nullptr;
+    _directories = nullptr;
+    _entries = nullptr;
+    _subdirs = nullptr;
+    _strings = nullptr;
+}
+
+#pragma mark - Reading
+
+size_t LibraryIndex::get_directory_count() const
+{
+    return (_header ? _header->directory_count : 0);
+}
+
+size_t LibraryIndex::get_entry_count() const
+{
+    return (_header ? _header->entry_count : 0);
+}
+
+const LibraryIndex::Directory* LibraryIndex::find_directory(const char *path) const
+{
+    if (!_header) {
+        return nullptr;
+    }
+    
+    // directories are stored sorted by path
+    size_t low = 0, high = _header->directory_count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(get_string(_directories[mid].path_offset), path);
+        if (cmp == 0) {
+            return &_directories[mid];
+        } else if (cmp < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    
+    return nullptr;
+}
+
+const LibraryIndex::Entry* LibraryIndex::get_entries(const Directory *dir) const
+{
+    return _entries + dir->first_entry;
+}
+
+const char* LibraryIndex::get_string(uint32_t offset) const
+{
+    return (offset < _header->strings_size ? _strings + offset : "");
+}
+
+bool LibraryIndex::load_directory(const std::string &path, int64_t mtime, LibraryDirectory &dir_out) const
+{
+    const Directory *dir = find_directory(path.c_str());
+    if (!dir || dir->mtime != mtime) {
+        // never seen, or files were added, removed or renamed since
+        return false;
+    }
+    
+    dir_out.path = path;
+    dir_out.mtime = mtime;
+    dir_out.entries.clear();
+    dir_out.subdirs.clear();
+    
+    const Entry *entries = get_entries(dir);
+    for (uint32_t i = 0; i < dir->entry_count; ++i) {
+        const Entry &entry = entries[i];
+        LibraryEntry lib_entry = { get_string(entry.name_offset), entry.size, entry.mtime, entry.format, TrackInfo() };
+        lib_entry.info.title = get_string(entry.title_offset);
+        lib_entry.info.artist = get_string(entry.artist_offset);
+        lib_entry.info.album = get_string(entry.album_offset);
+        lib_entry.info.duration_ms = entry.duration_ms;
+        dir_out.entries.push_back(lib_entry);
+    }
+    
+    for (uint32_t i = 0; i < dir->subdir_count; ++i) {
+        const Directory &subdir = _directories[_subdirs[dir->first_subdir + i]];
+        dir_out.subdirs.push_back(get_string(subdir.path_offset));
+    }
+    
+    return true;
+}
+
+#pragma mark - Writing
+
+bool LibraryIndex::write(std::string filename, std::vector<LibraryDirectory> &directories)
+{
+    std::sort(directories.begin(), directories.end(), [](const LibraryDirectory &a, const LibraryDirectory &b) {
+        return a.path < b.path;
+    });
+    
+    std::map<std::string, uint32_t> dir_indices;
+    for (uint32_t i = 0; i < directories.size(); ++i) {
+        dir_indices[directories[i].path] = i;
+    }
+    
+    std::vector<Directory> dir_records;
+    std::vector<Entry> entry_records;
+    std::vector<uint32_t> subdir_records;
+    std::string strings;
+    std::map<std::string, uint32_t> tag_strings; // artists and albums repeat across a directory
+    auto store_tag = [&strings, &tag_strings](const std::string &tag) -> uint32_t {
+        if (tag.empty()) {
+            return NO_STRING;
+        }
+        auto itr = tag_strings.find(tag);
+        if (itr != tag_strings.end()) {
+            return itr->second;
+        }
+        uint32_t offset = (uint32_t) strings.size();
+        strings.append(tag.c_str(), tag.size() + 1);
+        tag_strings[tag] = offset;
+        return offset;
+    };
+    
+    for (uint32_t i = 0; i < directories.size(); ++i) {
+        const LibraryDirectory &dir = directories[i];
+        Directory record = {0};
+        record.path_offset = (uint32_t) strings.size();
+        record.first_entry = (uint32_t) entry_records.size();
+        record.entry_count = (uint32_t) dir.entries.size();
+        record.first_subdir = (uint32_t) subdir_records.size();
+        record.mtime = dir.mtime;
+        strings.append(dir.path.c_str(), dir.path.size() + 1);
+        
+        for (auto &entry : dir.entries) {
+            Entry entry_record = {0};
+            entry_record.name_offset = (uint32_t) strings.size();
+            entry_record.directory = i;
+            entry_record.size = entry.size;
+            entry_record.mtime = entry.mtime;
+            entry_record.format = entry.format;
+            entry_record.duration_ms = entry.info.duration_ms;
+            strings.append(entry.name.c_str(), entry.name.size() + 1);
+            entry_record.title_offset = store_tag(entry.info.title);
+            entry_record.artist_offset = store_tag(entry.info.artist);
+            entry_record.album_offset = store_tag(entry.info.album);
+            entry_records.push_back(entry_record);
+        }
+        
+        for (auto &subdir : dir.subdirs) {
+            auto itr = dir_indices.find(subdir);
+            if (itr != dir_indices.end()) {
+                subdir_records.push_back(itr->second);
+            }
+        }
+        record.subdir_count = (uint32_t) subdir_records.size() - record.first_subdir;
+        dir_records.push_back(record);
+    }
+    
+    Header header = {0};
+    header.magic = INDEX_MAGIC;
+    header.version = INDEX_VERSION;
+    header.directory_count = (uint32_t) dir_records.size();
+    header.entry_count = (uint32_t) entry_records.size();
+    header.subdir_count = (uint32_t) subdir_records.size();
+    header.strings_size = (uint32_t) strings.size();
+    header.file_size = sizeof(Header) +
+                       dir_records.size() * sizeof(Directory) +
+                       entry_records.size() * sizeof(Entry) +
+                       subdir_records.size() * sizeof(uint32_t) +
+                       strings.size();
+    
+    // write next to the old index and swap it in, so a crash never leaves a torn file
+    mkdir(Util::dirname(filename).c_str(), 0755);
+    std::string tmp_filename = filename + ".tmp";
+    FILE *file = fopen(tmp_filename.c_str(), "wb");
+    if (!file) {
+        Logger::log_error("Warning: cannot write library index %s.", tmp_filename.c_str());
+        return false;
+    }
+    
+    bool success = (fwrite(&header, sizeof(header), 1, file) == 1);
+    success = success && (dir_records.empty() || fwrite(dir_records.data(), sizeof(Directory), dir_records.size(), file) == dir_records.size());
+    success = success && (entry_records.empty() || fwrite(entry_records.data(), sizeof(Entry), entry_records.size(), file) == entry_records.size());
+    success = success && (subdir_records.empty() || fwrite(subdir_records.data(), sizeof(uint32_t), subdir_records.size(), file) == subdir_records.size());
+    success = success && (strings.empty() || fwrite(strings.data(), 1, strings.size(), file) == strings.size());
+    success = (fclose(file) == 0) && success;
+    
+    if (success) {
+        success = (rename(tmp_filename.c_str(), filename.c_str()) == 0);
+    }
+    if (!success) {
+        Logger::log_error("Warning: cannot write library index %s.", filename.c_str());
+        unlink(tmp_filename.c_str());
+    }
+    
+    return success;
+}
+
+std::string LibraryIndex::default_filename()
+{
+    const char *home = getenv("HOME");
+    return (home ? std::string(home) + "/.djpi/library.idx" : std::string());
+}
+
+#pragma mark - Internal
+
+bool LibraryIndex::_validate() const
+{
+    if (_header->magic != INDEX_MAGIC || _header->version != INDEX_VERSION) {
+        return false;
+    }
+    
+    uint64_t expected_size = sizeof(Header) +
+                             (uint64_t) _header->directory_count * sizeof(Directory) +
+                             (uint64_t) _header->entry_count * sizeof(Entry) +
+                             (uint64_t) _header->subdir_count * sizeof(uint32_t) +
+                             _header->strings_size;
+    if (_header->file_size != expected_size || _mapping_size != expected_size) {
+        return false;
+    }
+    
+    // every string lookup relies on the pool being terminated
+    const char *base = (const char *) _mapping;
+    if (_header->strings_size > 0 && base[_mapping_size - 1] != '\0') {
+        return false;
+    }
+    
+    // make sure record ranges stay inside their tables
+    const Directory *directories = (const Directory *) (base + sizeof(Header));
+    const uint32_t *subdirs = (const uint32_t *) ((const Entry *) (directories + _header->directory_count) + _header->entry_count);
+    for (uint32_t i = 0; i < _header->directory_count; ++i) {
+        const Directory &dir = directories[i];
+        if ((uint64_t) dir.first_entry + dir.entry_count > _header->entry_count ||
+            (uint64_t) dir.first_subdir + dir.subdir_count > _header->subdir_count)
+        {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < _header->subdir_count; ++i) {
+        if (subdirs[i] >= _header->directory_count) {
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+} // namespace djpi
@@ -0,0 +1,104 @@
+/*
+ * library_index.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "track_table.h"
+
+namespace djpi {
+
+struct LibraryEntry {
+    std::string name;
+    uint64_t size;
+    int64_t mtime; // nanoseconds, a file rewritten in place doesn't touch its directory's
+    int16_t format; // see AudioManager::get_format_index
+    TrackInfo info;
+};
+
+struct LibraryDirectory {
+    std::string path;
+    int64_t mtime;
+    std::vector<LibraryEntry> entries;
+    std::vector<std::string> subdirs;
+};
+
+// Read-only view of the on-disk library index. The file is mapped as is and read in
+// place; records are only copied out when a directory is actually used.
+class LibraryIndex {
+public:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t directory_count;
+        uint32_t entry_count;
+        uint32_t subdir_count;
+        uint32_t strings_size;
+        uint64_t file_size;
+    };
+    
+    struct Directory {
+        uint32_t path_offset;
+        uint32_t first_entry;
+        uint32_t entry_count;
+        uint32_t first_subdir;
+        uint32_t subdir_count;
+        uint32_t reserved;
+        int64_t mtime;
+    };
+    
+    struct Entry {
+        uint32_t name_offset;
+        uint32_t directory;
+        uint64_t size;
+        int64_t mtime;
+        int16_t format;
+        uint16_t flags;
+        uint32_t duration_ms;
+        uint32_t title_offset;
+        uint32_t artist_offset;
+        uint32_t album_offset;
+        uint32_t reserved;
+    };
+    
+    LibraryIndex();
+    LibraryIndex(const LibraryIndex&) = delete;
+    ~LibraryIndex();
+    
+    // opening
+    bool open(std::string filename);
+    void close();
+    bool is_open() const { return _header != nullptr; }
+    
+    // reading
+    size_t get_directory_count() const;
+    size_t get_entry_count() const;
+    const Directory* find_directory(const char *path) const;
+    const Entry* get_entries(const Directory *dir) const;
+    const char* get_string(uint32_t offset) const;
+    bool load_directory(const std::string &path, int64_t mtime, LibraryDirectory &dir_out) const;
+    
+    // writing
+    static bool write(std::string filename, std::vector<LibraryDirectory> &directories);
+    static std::string default_filename();
+
+private:
+    bool _validate() const;
+
+protected:
+    void *_mapping;
+    size_t _mapping_size;
+    const Header *_header;
+    const Directory *_directories;
+    const Entry *_entries;
+    const uint32_t *_subdirs;
+    const char *_strings;
+};
+
+} // namespace djpi
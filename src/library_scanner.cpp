@@ -0,0 +1,425 @@
+/*
+ * library_scanner.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "library_scanner.h"
+#include "audio_manager.h"
+#include "io_scheduler.h"
+#include "logger.h"
+#include "tag_reader.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define DEFAULT_NUM_WORKERS     4
+#define MAX_NUM_WORKERS         16
+#define DIRENT_BUFFER_SIZE      (64 * 1024)
+
+#ifdef __linux__
+struct __linux_dirent64 {
+    ino64_t        d_ino;
+    off64_t        d_off;
+    unsigned short d_reclen;
+    unsigned char  d_type;
+    char           d_name[];
+};
+#endif
+
+static int64_t __mtime_ns(const struct stat &s)
+{
+#ifdef __APPLE__
+    return (int64_t) s.st_mtimespec.tv_sec * 1000000000LL + s.st_mtimespec.tv_nsec;
+#else
+    return (int64_t) s.st_mtim.tv_sec * 1000000000LL + s.st_mtim.tv_nsec;
+#endif
+}
+
+static std::string __join_path(const std::string &dir, const char *name)
+{
+    std::string path = dir;
+    if (path.empty() || path[path.size() - 1] != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+namespace djpi {
+
+LibraryScanner::LibraryScanner(unsigned num_workers) :
+    _num_workers(num_workers),
+    _collect_directories(false),
+    _read_tags(true),
+    _active_workers(0),
+    _stopping(false),
+    _directory_count(0),
+    _cached_directory_count(0),
+    _unsupported_count(0)
+{
+    if (_num_workers == 0) {
+        // the scan is bound by disk latency more than cpu, so a few workers go a long way
+        _num_workers = DEFAULT_NUM_WORKERS;
+    }
+    _num_workers = std::min(_num_workers, (unsigned) MAX_NUM_WORKERS);
+}
+
+LibraryScanner::~LibraryScanner()
+{
+    cancel();
+}
+
+#pragma mark - Scanning
+
+void LibraryScanner::start(const std::vector<std::string> &paths)
+{
+    for (auto path : paths) {
+        struct stat s;
+        if (stat(path.c_str(), &s) != 0) {
+            Logger::log_error("Warning: %s does not exist.", path.c_str());
+        } else if (S_ISDIR(s.st_mode)) {
+            _enqueue_directory(path);
+        } else if (AudioManager::supports_filename(path)) {
+            TrackInfo info;
+            if (_read_tags) {
+                TagReader::read(path, info);
+            }
+            info.file_size = s.st_size;
+            std::lock_guard<std::mutex> lock(_results_mutex);
+            _results.push_back(path);
+            _result_infos.push_back(info);
+        } else {
+            Logger::log_error("Warning: %s is an unsupported file type.", path.c_str());
+        }
+    }
+    
+    for (unsigned i = 0; i < _num_workers; ++i) {
+        _workers.push_back(std::thread(&LibraryScanner::_worker_main, this));
+    }
+}
+
+void LibraryScanner::wait()
+{
+    for (auto &worker : _workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+    _workers.clear();
+}
+
+void LibraryScanner::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        _stopping = true;
+        _pending_dirs.clear();
+    }
+    _queue_cond.notify_all();
+    wait();
+}
+
+bool LibraryScanner::is_finished()
+{
+    std::lock_guard<std::mutex> lock(_queue_mutex);
+    return _pending_dirs.empty() && _active_workers == 0;
+}
+
+#pragma mark - Results
+
+bool LibraryScanner::poll_results(std::vector<std::string> &filenames_out, std::vector<TrackInfo> &infos_out)
+{
+    std::lock_guard<std::mutex> lock(_results_mutex);
+    if (_results.empty()) {
+        return false;
+    }
+    
+    if (filenames_out.empty()) {
+        filenames_out.swap(_results);
+        infos_out.swap(_result_infos);
+    } else {
+        filenames_out.insert(filenames_out.end(), _results.begin(), _results.end());
+        infos_out.insert(infos_out.end(), _result_infos.begin(), _result_infos.end());
+        _results.clear();
+        _result_infos.clear();
+    }
+    return true;
+}
+
+size_t LibraryScanner::get_directory_count()
+{
+    std::lock_guard<std::mutex> lock(_results_mutex);
+    return _directory_count;
+}
+
+size_t LibraryScanner::get_unsupported_count()
+{
+    std::lock_guard<std::mutex> lock(_results_mutex);
+    return _unsupported_count;
+}
+
+size_t LibraryScanner::get_cached_directory_count()
+{
+    std::lock_guard<std::mutex> lock(_results_mutex);
+    return _cached_directory_count;
+}
+
+std::vector<LibraryDirectory> LibraryScanner::take_directories()
+{
+    std::lock_guard<std::mutex> lock(_results_mutex);
+    std::vector<LibraryDirectory> directories;
+    directories.swap(_directories);
+    return directories;
+}
+
+#pragma mark - Internal
+
+void LibraryScanner::_worker_main()
+{
+    std::unique_lock<std::mutex> lock(_queue_mutex);
+    while (true) {
+        _queue_cond.wait(lock, [this]() {
+            return _stopping || !_pending_dirs.empty() || _active_workers == 0;
+        });
+        
+        if (_stopping || _pending_dirs.empty()) {
+            // either cancelled, or nothing queued and nobody left to queue more
+            break;
+        }
+        
+        std::string path = _pending_dirs.front();
+        _pending_dirs.pop_front();
+        ++_active_workers;
+        
+        lock.unlock();
+        _scan_directory(path);
+        lock.lock();
+        
+        --_active_workers;
+        if (_active_workers == 0 && _pending_dirs.empty()) {
+            _queue_cond.notify_all();
+        }
+    }
+    
+    // the last batch is already out, this lets the loop see the scan has finished
+    bool stopping = _stopping;
+    lock.unlock();
+    if (!stopping && _result_handler) {
+        _result_handler();
+    }
+}
+
+void LibraryScanner::_scan_directory(const std::string &path)
+{
+    // scanning is background work, it gives way to playback reads
+    IoScheduler::wait_for_turn();
+    
+    struct stat s;
+    if (stat(path.c_str(), &s) != 0) {
+        Logger::log_error("Warning: cannot read directory %s.", path.c_str());
+        return;
+    }
+    
+    // the same directory can be reached through more than one symlink, only walk it once
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        if (!_visited_dirs.insert(std::make_pair(s.st_dev, s.st_ino)).second) {
+            return;
+        }
+    }
+    
+    // an unchanged directory mtime means no entries were added, removed or renamed,
+    // so the indexed listing can be used without reading the directory at all
+    LibraryDirectory dir;
+    int64_t mtime = __mtime_ns(s);
+    bool cached = (_index && _index->load_directory(path, mtime, dir));
+    if (!cached) {
+        int dir_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+        if (dir_fd < 0) {
+            Logger::log_error("Warning: cannot read directory %s.", path.c_str());
+            return;
+        }
+        
+        dir.path = path;
+        dir.mtime = mtime;
+        double start_time = IoScheduler::begin(IoScheduler::Class::BACKGROUND);
+        _read_entries(dir_fd, dir);
+        IoScheduler::end(IoScheduler::Class::BACKGROUND, start_time);
+        close(dir_fd);
+    } else if (_refresh_entries(dir)) {
+        // still listed from the index, but it has to be written out again
+        cached = false;
+    }
+    
+    for (auto &subdir : dir.subdirs) {
+        _enqueue_directory(subdir);
+    }
+    
+    std::sort(dir.entries.begin(), dir.entries.end(), [](const LibraryEntry &a, const LibraryEntry &b) {
+        return a.name < b.name;
+    });
+    std::vector<std::string> tracks;
+    tracks.reserve(dir.entries.size());
+    for (auto &entry : dir.entries) {
+        tracks.push_back(__join_path(path, entry.name.c_str()));
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(_results_mutex);
+        _results.insert(_results.end(), tracks.begin(), tracks.end());
+        for (auto &entry : dir.entries) {
+            _result_infos.push_back(entry.info);
+            _result_infos.back().file_size = entry.size;
+        }
+        ++_directory_count;
+        if (cached) {
+            ++_cached_directory_count;
+        }
+        if (_collect_directories) {
+            _directories.push_back(std::move(dir));
+        }
+    }
+    
+    // playback can start on this batch without waiting for the next tick
+    if (!tracks.empty() && _result_handler) {
+        _result_handler();
+    }
+}
+
+void LibraryScanner::_read_entries(int dir_fd, LibraryDirectory &dir)
+{
+#ifdef __linux__
+    // pull entries in large batches instead of one readdir() call at a time
+    std::vector<char> buffer(DIRENT_BUFFER_SIZE);
+    while (true) {
+        long nread = syscall(SYS_getdents64, dir_fd, buffer.data(), buffer.size());
+        if (nread <= 0) {
+            break;
+        }
+        
+        for (long offset = 0; offset < nread;) {
+            struct __linux_dirent64 *entry = (struct __linux_dirent64 *) (buffer.data() + offset);
+            _add_entry(dir_fd, dir, entry->d_name, entry->d_type);
+            offset += entry->d_reclen;
+        }
+    }
+#else
+    int dup_fd = dup(dir_fd);
+    DIR *dirptr = fdopendir(dup_fd);
+    if (dirptr == nullptr) {
+        close(dup_fd);
+        return;
+    }
+    
+    struct dirent *entry;
+    while ((entry = readdir(dirptr))) {
+        _add_entry(dir_fd, dir, entry->d_name, entry->d_type);
+    }
+    closedir(dirptr);
+#endif
+}
+
+void LibraryScanner::_add_entry(int dir_fd, LibraryDirectory &dir, const char *name, unsigned char type)
+{
+    if (name[0] == '.' || name[0] == '\0') {
+        return;
+    }
+    
+    struct stat s;
+    bool has_stat = false;
+    if (type == DT_UNKNOWN || type == DT_LNK) {
+        // the filesystem didn't tell us, or it's a symlink we need to resolve
+        if (fstatat(dir_fd, name, &s, 0) != 0) {
+            return;
+        }
+        has_stat = true;
+        type = (S_ISDIR(s.st_mode) ? DT_DIR : (S_ISREG(s.st_mode) ? DT_REG : DT_UNKNOWN));
+    }
+    
+    if (type == DT_DIR) {
+        dir.subdirs.push_back(__join_path(dir.path, name));
+    } else if (type == DT_REG) {
+        int format = AudioManager::get_format_index(name);
+        if (format >= 0) {
+            // only audio files are stat'ed, their size and mtime tell a later scan whether the
+            // cached tags still hold
+            if (!has_stat && fstatat(dir_fd, name, &s, 0) != 0) {
+                return;
+            }
+            LibraryEntry entry = { name, (uint64_t) s.st_size, __mtime_ns(s), (int16_t) format, TrackInfo() };
+            
+            // one read from the start of the file for most formats. the directory's worth of
+            // reads are already counted as background I/O, but each one still gives way to playback.
+            if (_read_tags) {
+                IoScheduler::wait_for_turn();
+                TagReader::read_at(dir_fd, name, entry.info);
+            }
+            dir.entries.push_back(entry);
+        } else {
+            std::lock_guard<std::mutex> lock(_results_mutex);
+            ++_unsupported_count;
+        }
+    }
+}
+
+bool LibraryScanner::_refresh_entries(LibraryDirectory &dir)
+{
+    // the directory's mtime only moves when entries are added, removed or renamed. a file
+    // rewritten or re-tagged in place only shows in its own size and mtime.
+    int dir_fd = open(dir.path.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd < 0) {
+        return false;
+    }
+    
+    bool changed = false;
+    double start_time = IoScheduler::begin(IoScheduler::Class::BACKGROUND);
+    auto itr = dir.entries.begin();
+    while (itr != dir.entries.end()) {
+        struct stat s;
+        if (fstatat(dir_fd, itr->name.c_str(), &s, 0) != 0 || !S_ISREG(s.st_mode)) {
+            itr = dir.entries.erase(itr);
+            changed = true;
+            continue;
+        }
+        
+        if ((uint64_t) s.st_size != itr->size || __mtime_ns(s) != itr->mtime) {
+            itr->size = s.st_size;
+            itr->mtime = __mtime_ns(s);
+            itr->info = TrackInfo();
+            if (_read_tags) {
+                IoScheduler::wait_for_turn();
+                TagReader::read_at(dir_fd, itr->name.c_str(), itr->info);
+            }
+            changed = true;
+        }
+        ++itr;
+    }
+    IoScheduler::end(IoScheduler::Class::BACKGROUND, start_time);
+    close(dir_fd);
+    return changed;
+}
+
+void LibraryScanner::_enqueue_directory(const std::string &path)
+{
+    {
+        std::lock_guard<std::mutex> lock(_queue_mutex);
+        if (_stopping) {
+            return;
+        }
+        _pending_dirs.push_back(path);
+    }
+    _queue_cond.notify_one();
+}
+
+} // namespace djpi
@@ -0,0 +1,82 @@
+/*
+ * library_scanner.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "library_index.h"
+
+namespace djpi {
+
+class LibraryScanner {
+public:
+    LibraryScanner(unsigned num_workers = 0); // 0 picks a default
+    ~LibraryScanner();
+    
+    // configuration
+    void set_index(std::shared_ptr<LibraryIndex> index) { _index = index; }
+    void set_collect_directories(bool collect) { _collect_directories = collect; }
+    void set_read_tags(bool read_tags) { _read_tags = read_tags; }
+    void set_result_handler(std::function<void()> handler) { _result_handler = handler; } // called on a worker thread
+    
+    // scanning
+    void start(const std::vector<std::string> &paths);
+    void wait();
+    void cancel();
+    bool is_finished();
+    
+    // results
+    bool poll_results(std::vector<std::string> &filenames_out, std::vector<TrackInfo> &infos_out); // one info per filename
+    size_t get_directory_count();
+    size_t get_unsupported_count();
+    size_t get_cached_directory_count();
+    std::vector<LibraryDirectory> take_directories();
+
+private:
+    void _worker_main();
+    void _scan_directory(const std::string &path);
+    void _read_entries(int dir_fd, LibraryDirectory &dir);
+    void _add_entry(int dir_fd, LibraryDirectory &dir, const char *name, unsigned char type);
+    bool _refresh_entries(LibraryDirectory &dir); // true if any file changed since it was indexed
+    void _enqueue_directory(const std::string &path);
+
+protected:
+    unsigned _num_workers;
+    std::vector<std::thread> _workers;
+    std::shared_ptr<LibraryIndex> _index;
+    bool _collect_directories;
+    bool _read_tags;
+    std::function<void()> _result_handler;
+    
+    std::mutex _queue_mutex;
+    std::condition_variable _queue_cond;
+    std::condition_variable _idle_cond;
+    std::deque<std::string> _pending_dirs;
+    std::set<std::pair<dev_t, ino_t>> _visited_dirs;
+    unsigned _active_workers;
+    bool _stopping;
+    
+    std::mutex _results_mutex;
+    std::vector<std::string> _results;
+    std::vector<TrackInfo> _result_infos;
+    size_t _directory_count;
+    size_t _cached_directory_count;
+    size_t _unsupported_count;
+    std::vector<LibraryDirectory> _directories;
+};
+
+} // namespace djpi
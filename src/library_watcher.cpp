@@ -0,0 +1,380 @@
+/*
+ * library_watcher.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "library_watcher.h"
+#include "audio_manager.h"
+#include "io_scheduler.h"
+#include "logger.h"
+#include "tag_reader.h"
+#include "util.h"
+
+#include <cerrno>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#define EVENT_BUFFER_SIZE       (64 * 1024)
+#define MAX_READS_PER_CALL      4       // the loop calls us again while there's more
+#define MAX_DIRS_PER_POLL       16      // new directories listed per update
+#define SETTLE_TIME             0.25    // seconds of quiet before a batch is released
+#define MAX_BATCH_DELAY         2.0     // release at least this often during a long copy
+
+#ifdef __linux__
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_DELETE_SELF | IN_ONLYDIR)
+#endif
+
+static std::string __join_path(const std::string &dir, const char *name)
+{
+    std::string path = dir;
+    if (path.empty() || path[path.size() - 1] != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+static bool __has_prefix(const std::string &path, const std::string &prefix)
+{
+    return path.compare(0, prefix.size(), prefix) == 0;
+}
+
+namespace djpi {
+
+LibraryWatcher::LibraryWatcher(bool read_tags) :
+    _notify_fd(-1),
+    _first_event_time(0.0),
+    _last_event_time(0.0),
+    _watch_limit_reached(false),
+    _read_tags(read_tags),
+    _stopping(false)
+{
+#ifdef __linux__
+    _notify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_notify_fd < 0) {
+        Logger::log_error("Unable to watch library for changes (errno %d).", errno);
+    }
+#endif
+    if (_notify_fd >= 0) {
+        _tag_worker = std::thread(&LibraryWatcher::_tag_worker_main, this);
+    }
+}
+
+LibraryWatcher::~LibraryWatcher()
+{
+    if (_tag_worker.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(_changes_lock);
+            _stopping = true;
+        }
+        _changes_cond.notify_all();
+        _tag_worker.join();
+    }
+    if (_notify_fd >= 0) {
+        close(_notify_fd);
+    }
+}
+
+#pragma mark - Watching
+
+bool LibraryWatcher::watch_directory(const std::string &path)
+{
+#ifdef __linux__
+    if (_notify_fd < 0) {
+        return false;
+    }
+    
+    // the same directory reached through another path, a symlink loop say, hands back the wd it
+    // already has. that one stays pointed at the path it was first watched under.
+    int wd = inotify_add_watch(_notify_fd, path.c_str(), WATCH_MASK);
+    if (wd >= 0 && _watch_paths.count(wd) > 0) {
+        return _watch_paths[wd] == path;
+    }
+    if (wd < 0) {
+        if (errno == ENOSPC && !_watch_limit_reached) {
+            Logger::log_error("Warning: ran out of inotify watches, raise fs.inotify.max_user_watches to watch the whole library.");
+            _watch_limit_reached = true;
+        }
+        return false;
+    }
+    
+    _watch_paths[wd] = path;
+    _path_watches[path] = wd;
+    return true;
+#else
+    return false;
+#endif
+}
+
+#pragma mark - Events
+
+void LibraryWatcher::read_events()
+{
+#ifdef __linux__
+    // aligned for the event headers
+    static uint64_t __buffer[EVENT_BUFFER_SIZE / sizeof(uint64_t)];
+    char *buffer = (char *) __buffer;
+    
+    for (int i = 0; i < MAX_READS_PER_CALL; ++i) {
+        ssize_t length = read(_notify_fd, buffer, EVENT_BUFFER_SIZE);
+        if (length <= 0) {
+            break;
+        }
+        
+        for (ssize_t offset = 0; offset < length; ) {
+            const struct inotify_event *event = (const struct inotify_event *) (buffer + offset);
+            _handle_event(event->wd, event->mask, (event->len > 0 ? event->name : ""));
+            offset += sizeof(struct inotify_event) + event->len;
+        }
+    }
+#endif
+}
+
+bool LibraryWatcher::poll_changes(std::vector<std::string> &added_out, std::vector<TrackInfo> &infos_out,
+                                  std::set<std::string> &removed_out)
+{
+    // new directories are listed a few at a time so a large tree being moved in can't stall the loop
+    _scan_new_directories();
+    _settle_changes();
+    
+    std::lock_guard<std::mutex> lock(_changes_lock);
+    if (_ready_changes.empty()) {
+        return false;
+    }
+    
+    Changes &changes = _ready_changes.front();
+    added_out.swap(changes.added);
+    infos_out.swap(changes.infos);
+    removed_out.swap(changes.removed);
+    _ready_changes.pop_front();
+    return true;
+}
+
+#pragma mark - Internal
+
+void LibraryWatcher::_settle_changes()
+{
+    if (_added_paths.empty() && _removed_paths.empty()) {
+        return;
+    }
+    
+    double now = Util::current_time();
+    bool settled = (now - _last_event_time >= SETTLE_TIME && _new_dirs.empty());
+    if (!settled && now - _first_event_time < MAX_BATCH_DELAY) {
+        return;
+    }
+    
+    Changes changes;
+    changes.added.assign(_added_paths.begin(), _added_paths.end());
+    changes.infos.resize(changes.added.size());
+    changes.removed.swap(_removed_paths);
+    _added_paths.clear();
+    _first_event_time = 0.0;
+    
+    {
+        std::lock_guard<std::mutex> lock(_changes_lock);
+        _unread_changes.push_back(std::move(changes));
+    }
+    _changes_cond.notify_one();
+}
+
+void LibraryWatcher::_tag_worker_main()
+{
+    std::unique_lock<std::mutex> lock(_changes_lock);
+    while (true) {
+        _changes_cond.wait(lock, [this]() { return _stopping || !_unread_changes.empty(); });
+        if (_stopping) {
+            break;
+        }
+        
+        // the size for the load policy, and a read from the start of each file for its tags.
+        // background work that gives way to playback.
+        Changes changes = std::move(_unread_changes.front());
+        _unread_changes.pop_front();
+        lock.unlock();
+        for (size_t i = 0; i < changes.added.size(); ++i) {
+            IoScheduler::wait_for_turn();
+            if (_read_tags) {
+                TagReader::read(changes.added[i], changes.infos[i]);
+            }
+            struct stat s;
+            if (stat(changes.added[i].c_str(), &s) == 0) {
+                changes.infos[i].file_size = s.st_size;
+            }
+        }
+        lock.lock();
+        _ready_changes.push_back(std::move(changes));
+        
+        if (_change_handler) {
+            lock.unlock();
+            _change_handler();
+            lock.lock();
+        }
+    }
+}
+
+void LibraryWatcher::_handle_event(int wd, uint32_t mask, const char *name)
+{
+#ifdef __linux__
+    if (mask & IN_Q_OVERFLOW) {
+        Logger::log_error("Warning: missed library changes, the kernel event queue overflowed.");
+        return;
+    }
+    
+    auto itr = _watch_paths.find(wd);
+    if (itr == _watch_paths.end()) {
+        return;
+    }
+    
+    std::string dir_path = itr->second;
+    if (mask & IN_IGNORED) {
+        // the directory is gone or we stopped watching it
+        _watch_paths.erase(itr);
+        auto path_itr = _path_watches.find(dir_path);
+        if (path_itr != _path_watches.end() && path_itr->second == wd) {
+            _path_watches.erase(path_itr);
+        }
+        return;
+    }
+    
+    if (mask & IN_DELETE_SELF) {
+        _remove_path(dir_path, true);
+        return;
+    }
+    
+    if (name[0] == '.') {
+        // hidden files, including the temp files rsync and friends rename into place
+        return;
+    }
+    
+    std::string path = __join_path(dir_path, name);
+    bool is_directory = (mask & IN_ISDIR);
+    if (mask & (IN_DELETE | IN_MOVED_FROM)) {
+        _remove_path(path, is_directory);
+    } else if (is_directory && (mask & (IN_CREATE | IN_MOVED_TO))) {
+        _new_dirs.push_back(path);
+        _note_event();
+    } else if (!is_directory && (mask & (IN_CLOSE_WRITE | IN_MOVED_TO))) {
+        // files are picked up once they're closed, not when they're created, so we never
+        // hand out a half-copied file
+        if (AudioManager::supports_filename(path)) {
+            _add_path(path);
+        }
+    }
+#endif
+}
+
+void LibraryWatcher::_add_path(const std::string &path)
+{
+    _removed_paths.erase(path);
+    _added_paths.insert(path);
+    _note_event();
+}
+
+void LibraryWatcher::_remove_path(const std::string &path, bool is_directory)
+{
+    _added_paths.erase(path);
+    if (is_directory) {
+        // drop anything we were about to add from inside it
+        std::string prefix = path + "/";
+        auto itr = _added_paths.lower_bound(prefix);
+        while (itr != _added_paths.end() && __has_prefix(*itr, prefix)) {
+            itr = _added_paths.erase(itr);
+        }
+        _forget_directory(path);
+    }
+    
+    _removed_paths.insert(path);
+    _note_event();
+}
+
+void LibraryWatcher::_forget_directory(const std::string &path)
+{
+#ifdef __linux__
+    // a directory moved somewhere else keeps its watches, so remove them for the whole subtree
+    auto itr = _path_watches.find(path);
+    if (itr != _path_watches.end()) {
+        inotify_rm_watch(_notify_fd, itr->second);
+        _watch_paths.erase(itr->second);
+        _path_watches.erase(itr);
+    }
+    
+    std::string prefix = path + "/";
+    itr = _path_watches.lower_bound(prefix);
+    while (itr != _path_watches.end() && __has_prefix(itr->first, prefix)) {
+        inotify_rm_watch(_notify_fd, itr->second);
+        _watch_paths.erase(itr->second);
+        itr = _path_watches.erase(itr);
+    }
+#endif
+}
+
+void LibraryWatcher::_scan_new_directories()
+{
+    for (int i = 0; i < MAX_DIRS_PER_POLL && !_new_dirs.empty(); ++i) {
+        std::string path = _new_dirs.front();
+        _new_dirs.pop_front();
+        
+        // symlinks can lead back into a directory we've just listed, walk each one only once.
+        // a loop is found within the same burst, so the set only lives until the queue is empty.
+        struct stat s;
+        if (stat(path.c_str(), &s) != 0 || !_visited_dirs.insert(std::make_pair(s.st_dev, s.st_ino)).second) {
+            continue;
+        }
+        
+        // watch before listing, so files copied in between show up either way
+        if (!watch_directory(path)) {
+            continue;
+        }
+        
+        DIR *dir = opendir(path.c_str());
+        if (!dir) {
+            continue;
+        }
+        
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL) {
+            const char *name = entry->d_name;
+            if (name[0] == '.') {
+                continue;
+            }
+            
+            std::string entry_path = __join_path(path, name);
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                struct stat s;
+                if (stat(entry_path.c_str(), &s) == 0) {
+                    type = (S_ISDIR(s.st_mode) ? DT_DIR : (S_ISREG(s.st_mode) ? DT_REG : DT_UNKNOWN));
+                }
+            }
+            
+            if (type == DT_DIR) {
+                _new_dirs.push_back(entry_path);
+            } else if (type == DT_REG && AudioManager::supports_filename(entry_path)) {
+                _add_path(entry_path);
+            }
+        }
+        closedir(dir);
+    }
+    
+    if (_new_dirs.empty()) {
+        _visited_dirs.clear();
+    }
+}
+
+void LibraryWatcher::_note_event()
+{
+    _last_event_time = Util::current_time();
+    if (_first_event_time == 0.0) {
+        _first_event_time = _last_event_time;
+    }
+}
+
+} // namespace djpi
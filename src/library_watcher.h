@@ -0,0 +1,88 @@
+/*
+ * library_watcher.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "track_table.h"
+
+namespace djpi {
+
+// Watches the scanned directories for files being added or removed. Events are only
+// collected when the descriptor is readable and handed out in batches once they settle,
+// so a bulk copy turns into a handful of playlist updates instead of one per file. Added files
+// are stat'ed and their tags read on a thread of the watcher's own, so a big batch can't stall the loop.
+class LibraryWatcher {
+public:
+    LibraryWatcher(bool read_tags = true);
+    ~LibraryWatcher();
+    
+    // watching
+    bool is_available() const { return _notify_fd >= 0; } // only on linux for now
+    int get_fd() const { return _notify_fd; }
+    void set_change_handler(std::function<void()> handler) { _change_handler = handler; } // called on the tag thread
+    bool watch_directory(const std::string &path);
+    size_t get_watch_count() const { return _watch_paths.size(); }
+    
+    // events
+    void read_events();
+    bool poll_changes(std::vector<std::string> &added_out, std::vector<TrackInfo> &infos_out, // one info per added file
+                      std::set<std::string> &removed_out);
+
+private:
+    struct Changes {
+        std::vector<std::string> added;
+        std::vector<TrackInfo> infos;
+        std::set<std::string> removed;
+    };
+    
+    void _settle_changes();
+    void _tag_worker_main();
+    void _handle_event(int wd, uint32_t mask, const char *name);
+    void _add_path(const std::string &path);
+    void _remove_path(const std::string &path, bool is_directory);
+    void _forget_directory(const std::string &path);
+    void _scan_new_directories();
+    void _note_event();
+
+protected:
+    int _notify_fd;
+    std::unordered_map<int, std::string> _watch_paths;
+    std::map<std::string, int> _path_watches;
+    
+    std::set<std::string> _added_paths;
+    std::set<std::string> _removed_paths;
+    std::deque<std::string> _new_dirs;
+    std::set<std::pair<dev_t, ino_t>> _visited_dirs;
+    double _first_event_time;
+    double _last_event_time;
+    bool _watch_limit_reached;
+    
+    // settled batches, handed out in the order they settled so a removal can't overtake its add
+    bool _read_tags;
+    std::function<void()> _change_handler;
+    std::thread _tag_worker;
+    std::mutex _changes_lock;
+    std::condition_variable _changes_cond;
+    std::deque<Changes> _unread_changes;
+    std::deque<Changes> _ready_changes;
+    bool _stopping;
+};
+
+} // namespace djpi
@@ -0,0 +1,155 @@
+/*
+ * load_policy.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "load_policy.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define SAMPLE_MAX_PCM_SIZE         (8 * 1024 * 1024) // decoded bytes, about 45 seconds of CD audio
+#define COMPRESSED_SAMPLE_MAX_SIZE  (2 * 1024 * 1024) // file bytes, a couple of minutes of MP3
+#define MEMORY_HEADROOM             4                 // never take more than a quarter of what's free
+
+static int __mode_index(djpi::LoadMode mode)
+{
+    switch (mode) {
+        case djpi::LoadMode::SAMPLE:
+            return 1;
+        case djpi::LoadMode::COMPRESSED_SAMPLE:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+static bool __is_one_of(const std::string &extension, const char **extensions, size_t count)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (extension == extensions[i]) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static unsigned long long __estimate_pcm_size(const std::string &extension, unsigned long long file_size)
+{
+    // roughly how much bigger each format gets once decoded
+    static const char *__uncompressed[] = {"WAV", "AIFF", "RAW", "VAG", "GCADPCM"};
+    static const char *__lossless[] = {"FLAC"};
+    if (__is_one_of(extension, __uncompressed, sizeof(__uncompressed) / sizeof(__uncompressed[0]))) {
+        return file_size;
+    } else if (__is_one_of(extension, __lossless, sizeof(__lossless) / sizeof(__lossless[0]))) {
+        return file_size * 2;
+    }
+    return file_size * 11;
+}
+
+namespace djpi {
+
+LoadPolicy::LoadPolicy()
+{
+    memset(_counters, 0, sizeof(_counters));
+}
+
+LoadDecision LoadPolicy::choose(const std::string &filename, unsigned long long file_size, size_t memory_available) const
+{
+    static const char *__modules[] = {"IT", "MOD", "XM", "S3M"};
+    static const char *__compressible[] = {"MP3", "MP2"};
+    
+    std::string extension = Util::filename_ext(filename);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::toupper);
+    
+    LoadDecision decision = {LoadMode::STREAM, "long track"};
+    if (__is_one_of(extension, __modules, sizeof(__modules) / sizeof(__modules[0]))) {
+        // sequenced from their own samples instead of being rendered through a stream
+        decision.mode = LoadMode::SAMPLE;
+        decision.reason = "tracker module";
+        return decision;
+    }
+    
+    if (file_size == 0) {
+        decision.reason = "unknown size";
+        return decision;
+    }
+    
+    unsigned long long pcm_size = __estimate_pcm_size(extension, file_size);
+    bool compressible = __is_one_of(extension, __compressible, sizeof(__compressible) / sizeof(__compressible[0]));
+    if (pcm_size <= SAMPLE_MAX_PCM_SIZE) {
+        if (pcm_size * MEMORY_HEADROOM <= memory_available) {
+            decision.mode = LoadMode::SAMPLE;
+            decision.reason = "short track";
+        } else {
+            decision.reason = "short track, but memory is low";
+        }
+    } else if (compressible && file_size <= COMPRESSED_SAMPLE_MAX_SIZE) {
+        if (file_size * MEMORY_HEADROOM <= memory_available) {
+            decision.mode = LoadMode::COMPRESSED_SAMPLE;
+            decision.reason = "short compressed track";
+        } else {
+            decision.reason = "short compressed track, but memory is low";
+        }
+    }
+    return decision;
+}
+
+void LoadPolicy::record_open(LoadMode mode, double open_time)
+{
+    Counters &counters = _counters[__mode_index(mode)];
+    ++counters.opened;
+    counters.total_open_time += open_time;
+    counters.slowest_open_time = std::max(counters.slowest_open_time, open_time);
+}
+
+void LoadPolicy::record_playback(LoadMode mode, double cpu)
+{
+    Counters &counters = _counters[__mode_index(mode)];
+    ++counters.played;
+    counters.total_cpu += cpu;
+}
+
+LoadModeStats LoadPolicy::get_stats(LoadMode mode) const
+{
+    const Counters &counters = _counters[__mode_index(mode)];
+    LoadModeStats stats;
+    stats.opened = counters.opened;
+    stats.average_open_time = (counters.opened > 0 ? counters.total_open_time / counters.opened : 0.0);
+    stats.slowest_open_time = counters.slowest_open_time;
+    stats.played = counters.played;
+    stats.average_cpu = (counters.played > 0 ? counters.total_cpu / counters.played : 0.0);
+    return stats;
+}
+
+#pragma mark - Static Methods
+
+const char* LoadPolicy::get_mode_name(LoadMode mode)
+{
+    switch (mode) {
+        case LoadMode::SAMPLE:
+            return "sample";
+        case LoadMode::COMPRESSED_SAMPLE:
+            return "compressed sample";
+        default:
+            return "stream";
+    }
+}
+
+FMOD_MODE LoadPolicy::get_fmod_mode(LoadMode mode)
+{
+    switch (mode) {
+        case LoadMode::SAMPLE:
+            return FMOD_CREATESAMPLE;
+        case LoadMode::COMPRESSED_SAMPLE:
+            // the mixer decodes these itself, which only the software mixer can do
+            return FMOD_CREATECOMPRESSEDSAMPLE | FMOD_SOFTWARE;
+        default:
+            return FMOD_CREATESTREAM;
+    }
+}
+
+} // namespace djpi
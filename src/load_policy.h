@@ -0,0 +1,63 @@
+/*
+ * load_policy.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <cstddef>
+#include <fmod/fmod.hpp>
+#include <string>
+
+namespace djpi {
+
+enum class LoadMode {
+    STREAM,
+    SAMPLE, // decoded into memory up front
+    COMPRESSED_SAMPLE // kept in memory as it is on disk, decoded as it plays
+};
+
+struct LoadDecision {
+    LoadMode mode;
+    const char *reason;
+};
+
+struct LoadModeStats {
+    size_t opened;
+    double average_open_time; // milliseconds
+    double slowest_open_time;
+    size_t played;
+    double average_cpu; // percent of a core spent mixing and streaming while these played
+};
+
+// Picks how each track is opened. Long tracks stream, but short ones and tracker modules are
+// cheaper loaded whole, as long as there's memory to spare. Also keeps track of how each
+// choice turned out, so the thresholds can be tuned.
+class LoadPolicy {
+public:
+    LoadPolicy();
+    
+    LoadDecision choose(const std::string &filename, unsigned long long file_size, size_t memory_available) const;
+    
+    void record_open(LoadMode mode, double open_time);
+    void record_playback(LoadMode mode, double cpu);
+    LoadModeStats get_stats(LoadMode mode) const;
+    
+    static const char* get_mode_name(LoadMode mode);
+    static FMOD_MODE get_fmod_mode(LoadMode mode);
+
+protected:
+    struct Counters {
+        size_t opened;
+        double total_open_time;
+        double slowest_open_time;
+        size_t played;
+        double total_cpu;
+    };
+    
+    Counters _counters[3];
+};
+
+} // namespace djpi
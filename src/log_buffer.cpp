@@ -0,0 +1,219 @@
+/*
+ * log_buffer.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "log_buffer.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#define SLOT_TEXT_SIZE      sizeof(Slot::text)
+#define BATCH_SIZE          (64 * 1024)
+#define IDLE_TIMEOUT_MS     500 // only matters if a wakeup races with the writer going to sleep
+
+namespace djpi {
+
+LogBuffer::LogBuffer(size_t slot_count, LogFormatter formatter) :
+    _slots(slot_count),
+    _write_position(0),
+    _read_position(0),
+    _dropped_count(0),
+    _reported_dropped_count(0),
+    _formatter(formatter),
+    _writer_sleeping(false),
+    _stopping(false)
+{
+    for (size_t i = 0; i < slot_count; ++i) {
+        _slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    _writer = std::thread(&LogBuffer::_writer_main, this);
+}
+
+LogBuffer::~LogBuffer()
+{
+    _stopping.store(true);
+    _wake_writer();
+    if (_writer.joinable()) {
+        _writer.join();
+    }
+}
+
+#pragma mark - Queueing
+
+bool LogBuffer::push(int fd, const char *text, size_t length)
+{
+    size_t slot_count = _slots.size();
+    size_t span = std::max((size_t) 1, (length + SLOT_TEXT_SIZE - 1) / SLOT_TEXT_SIZE);
+    if (span > slot_count / 2 || length > UINT16_MAX) {
+        _dropped_count.fetch_add(1);
+        return false;
+    }
+    
+    // claim `span` consecutive slots. the writer frees slots in order, so if the last one is
+    // free all of the ones before it are too.
+    uint64_t position = _write_position.load(std::memory_order_relaxed);
+    while (true) {
+        uint64_t last = position + span - 1;
+        uint64_t sequence = _slots[last % slot_count].sequence.load(std::memory_order_acquire);
+        if (sequence < last) {
+            // the ring is full
+            _dropped_count.fetch_add(1);
+            return false;
+        } else if (sequence > last) {
+            // somebody else claimed it first
+            position = _write_position.load(std::memory_order_relaxed);
+        } else if (_write_position.compare_exchange_weak(position, position + span, std::memory_order_relaxed)) {
+            break;
+        }
+    }
+    
+    // copy the line in, publishing the first slot last so the writer sees the whole thing at once
+    for (size_t i = 0; i < span; ++i) {
+        Slot &slot = _slots[(position + i) % slot_count];
+        size_t offset = i * SLOT_TEXT_SIZE;
+        memcpy(slot.text, text + offset, std::min(length - std::min(length, offset), SLOT_TEXT_SIZE));
+        if (i > 0) {
+            slot.sequence.store(position + i + 1, std::memory_order_release);
+        }
+    }
+    
+    Slot &first = _slots[position % slot_count];
+    first.length = (uint16_t) length;
+    first.fd = (uint8_t) fd;
+    first.span = (uint8_t) span;
+    first.sequence.store(position + 1);
+    
+    if (_writer_sleeping.load()) {
+        // never wait on the writer from here. if it's holding the mutex it's about to look at
+        // the ring again or go to sleep, and the idle timeout covers the second case.
+        std::unique_lock<std::mutex> lock(_writer_mutex, std::try_to_lock);
+        _writer_cond.notify_one();
+    }
+    return true;
+}
+
+void LogBuffer::flush()
+{
+    uint64_t target = _write_position.load();
+    while (_read_position.load() < target && _writer.joinable()) {
+        _wake_writer();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+#pragma mark - Internal
+
+void LogBuffer::_writer_main()
+{
+    std::string batch;
+    batch.reserve(BATCH_SIZE);
+    
+    while (true) {
+        bool stopping = _stopping.load();
+        if (_drain(batch) > 0) {
+            continue;
+        } else if (stopping) {
+            break;
+        }
+        
+        std::unique_lock<std::mutex> lock(_writer_mutex);
+        _writer_sleeping.store(true);
+        if (!_has_pending() && !_stopping.load()) {
+            _writer_cond.wait_for(lock, std::chrono::milliseconds(IDLE_TIMEOUT_MS));
+        }
+        _writer_sleeping.store(false);
+    }
+}
+
+size_t LogBuffer::_drain(std::string &batch)
+{
+    size_t slot_count = _slots.size();
+    size_t line_count = 0;
+    int batch_fd = -1;
+    uint64_t position = _read_position.load(std::memory_order_relaxed);
+    
+    while (_has_pending() && batch.size() < BATCH_SIZE) {
+        Slot &first = _slots[position % slot_count];
+        size_t length = first.length;
+        size_t span = first.span;
+        
+        // switching between stdout and stderr ends the batch, so lines keep their order
+        if (first.fd != batch_fd) {
+            _write_batch(batch_fd, batch);
+            batch_fd = first.fd;
+        }
+        
+        // the first slot is published last, so the rest of the line is already in place
+        std::string &text = (_formatter ? _record : batch);
+        _record.clear();
+        for (size_t i = 0; i < span; ++i) {
+            const Slot &slot = _slots[(position + i) % slot_count];
+            size_t offset = i * SLOT_TEXT_SIZE;
+            text.append(slot.text, std::min(length - offset, SLOT_TEXT_SIZE));
+        }
+        if (_formatter) {
+            _formatter(_record.data(), _record.size(), batch);
+        }
+        batch += '\n';
+        
+        // hand the slots back for the next lap around the ring
+        for (size_t i = 0; i < span; ++i) {
+            _slots[(position + i) % slot_count].sequence.store(position + i + slot_count, std::memory_order_release);
+        }
+        position += span;
+        _read_position.store(position);
+        ++line_count;
+    }
+    
+    _write_batch(batch_fd, batch);
+    
+    // let the reader know there are holes in the output
+    size_t dropped_count = _dropped_count.load();
+    if (dropped_count > _reported_dropped_count) {
+        batch = "[" + std::to_string(dropped_count - _reported_dropped_count) + " log lines dropped]\n";
+        _write_batch(STDERR_FILENO, batch);
+        _reported_dropped_count = dropped_count;
+    }
+    
+    return line_count;
+}
+
+bool LogBuffer::_has_pending()
+{
+    uint64_t position = _read_position.load(std::memory_order_relaxed);
+    return _slots[position % _slots.size()].sequence.load() == position + 1;
+}
+
+void LogBuffer::_write_batch(int fd, std::string &batch)
+{
+    if (fd < 0) {
+        return;
+    }
+    
+    size_t written = 0;
+    while (written < batch.size()) {
+        ssize_t result = write(fd, batch.data() + written, batch.size() - written);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            break;
+        }
+        written += result;
+    }
+    batch.clear();
+}
+
+void LogBuffer::_wake_writer()
+{
+    std::lock_guard<std::mutex> lock(_writer_mutex);
+    _writer_cond.notify_one();
+}
+
+} // namespace djpi
@@ -0,0 +1,68 @@
+/*
+ * log_buffer.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace djpi {
+
+// turns one pushed record into text, on the writer thread
+typedef void (*LogFormatter)(const char *data, size_t length, std::string &text_out);
+
+// A bounded multi-producer ring of log lines, emptied by a background thread that writes them
+// out in batches. Lines can be pushed as text, or as records that the formatter turns into text
+// on the writer thread. Pushing never blocks: when the ring is full the line is dropped and
+// counted instead.
+class LogBuffer {
+public:
+    LogBuffer(size_t slot_count, LogFormatter formatter = nullptr);
+    ~LogBuffer(); // writes out anything still queued
+    
+    // queueing
+    bool push(int fd, const char *text, size_t length);
+    void flush(); // waits until everything queued so far has been written
+    size_t get_dropped_count() const { return _dropped_count.load(); }
+
+private:
+    void _writer_main();
+    size_t _drain(std::string &batch);
+    bool _has_pending();
+    void _write_batch(int fd, std::string &batch);
+    void _wake_writer();
+
+protected:
+    struct Slot {
+        std::atomic<uint64_t> sequence; // == position when free, position + 1 once filled
+        uint16_t length;                // whole line, only set on the first slot
+        uint8_t fd;
+        uint8_t span;                   // slots used by the line
+        char text[116];
+    };
+    
+    std::vector<Slot> _slots;
+    std::atomic<uint64_t> _write_position;
+    std::atomic<uint64_t> _read_position;
+    std::atomic<size_t> _dropped_count;
+    size_t _reported_dropped_count; // writer thread only
+    LogFormatter _formatter;
+    std::string _record; // writer thread only
+    
+    std::thread _writer;
+    std::mutex _writer_mutex;
+    std::condition_variable _writer_cond;
+    std::atomic<bool> _writer_sleeping;
+    std::atomic<bool> _stopping;
+};
+
+} // namespace djpi
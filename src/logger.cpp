@@ -6,34 +6,201 @@
  */
 
 #include "logger.h"
+#include "log_buffer.h"
+
+#include <algorithm>
 #include <cstdio>
+#include <cstring>
+#include <unistd.h>
+
+#define MAX_LINE_LENGTH     4096
+#define MAX_SPEC_LENGTH     16
+#define RING_SLOTS          8192 // 128 bytes each
+
+static djpi::LogBuffer& __get_buffer()
+{
+    // created on first use and drained by its destructor when the process exits
+    static djpi::LogBuffer __buffer(RING_SLOTS, &djpi::LogRecord::format);
+    return __buffer;
+}
 
-#define BUFFER_SIZE 1024
+static bool __read_arg(const char *data, size_t length, size_t &position, djpi::LogRecord::ArgType &type_out,
+                       uint64_t &value_out, std::string &string_out)
+{
+    if (position >= length) {
+        return false;
+    }
+    
+    type_out = (djpi::LogRecord::ArgType) data[position++];
+    if (type_out == djpi::LogRecord::ArgType::STRING) {
+        uint16_t string_length;
+        if (position + sizeof(string_length) > length) {
+            return false;
+        }
+        memcpy(&string_length, data + position, sizeof(string_length));
+        position += sizeof(string_length);
+        string_out.assign(data + position, std::min((size_t) string_length, length - position));
+        position += string_out.size();
+    } else {
+        if (position + sizeof(value_out) > length) {
+            return false;
+        }
+        memcpy(&value_out, data + position, sizeof(value_out));
+        position += sizeof(value_out);
+    }
+    return true;
+}
+
+static void __format_arg(std::string spec, char conversion, djpi::LogRecord::ArgType type, uint64_t value,
+                         const std::string &string, std::string &text_out)
+{
+    // flags, width and precision come from the format, the length modifier from the stored type
+    char buf[MAX_LINE_LENGTH];
+    int length = 0;
+    bool is_integer = (strchr("diouxX", conversion) != NULL);
+    switch (type) {
+        case djpi::LogRecord::ArgType::INT:
+        case djpi::LogRecord::ArgType::UINT:
+            if (conversion == 'c') {
+                length = snprintf(buf, sizeof(buf), (spec + "c").c_str(), (int) value);
+            } else if (type == djpi::LogRecord::ArgType::INT) {
+                length = snprintf(buf, sizeof(buf), (spec + "ll" + (is_integer ? conversion : 'd')).c_str(), (long long) value);
+            } else {
+                length = snprintf(buf, sizeof(buf), (spec + "ll" + (is_integer ? conversion : 'u')).c_str(), (unsigned long long) value);
+            }
+            break;
+        case djpi::LogRecord::ArgType::DOUBLE: {
+            double double_value;
+            memcpy(&double_value, &value, sizeof(double_value));
+            bool is_float = (strchr("eEfFgGaA", conversion) != NULL);
+            length = snprintf(buf, sizeof(buf), (spec + (is_float ? conversion : 'f')).c_str(), double_value);
+            break;
+        }
+        case djpi::LogRecord::ArgType::STRING:
+            if (spec == "%") {
+                text_out += string;
+                return;
+            }
+            length = snprintf(buf, sizeof(buf), (spec + "s").c_str(), string.c_str());
+            break;
+        case djpi::LogRecord::ArgType::POINTER:
+            length = snprintf(buf, sizeof(buf), "%p", (void *) (uintptr_t) value);
+            break;
+    }
+    
+    if (length > 0) {
+        text_out.append(buf, std::min((size_t) length, sizeof(buf) - 1));
+    }
+}
 
 namespace djpi {
 
-void Logger::log(const char *format, ...)
+#pragma mark - LogRecord
+
+LogRecord::LogRecord(const char *format) :
+    _length(sizeof(format))
 {
-    va_list args;
-    va_start(args, format);
-    logv(format, args);
-    va_end(args);
+    memcpy(_data, &format, sizeof(format));
 }
 
-void Logger::log_error(const char *format, ...)
+void LogRecord::append(const char *string)
 {
-    va_list args;
-    va_start(args, format);
-    logv(format, args, &std::cerr);
-    va_end(args);
+    if (_length + 1 + sizeof(uint16_t) > sizeof(_data)) {
+        _length = sizeof(_data); // no room, the rest of the arguments are left out too
+        return;
+    }
+    
+    // cut short to whatever room is left
+    size_t full_length = (string ? strlen(string) : 0);
+    size_t string_length = std::min(full_length, sizeof(_data) - _length - 1 - sizeof(uint16_t));
+    uint16_t stored_length = (uint16_t) string_length;
+    _data[_length++] = (char) ArgType::STRING;
+    memcpy(_data + _length, &stored_length, sizeof(stored_length));
+    _length += sizeof(stored_length);
+    memcpy(_data + _length, string, string_length);
+    _length += string_length;
+    if (string_length < full_length && string_length >= 3) {
+        memcpy(_data + _length - 3, "...", 3);
+    }
 }
 
-void Logger::logv(const char *format, va_list args, std::ostream *stream)
+void LogRecord::_append_value(ArgType type, uint64_t value)
 {
-    char buf[BUFFER_SIZE];
-    vsprintf(buf, format, args);
+    if (_length + 1 + sizeof(value) > sizeof(_data)) {
+        _length = sizeof(_data);
+        return;
+    }
     
-    (*stream) << buf << std::endl;
+    _data[_length++] = (char) type;
+    memcpy(_data + _length, &value, sizeof(value));
+    _length += sizeof(value);
+}
+
+void LogRecord::format(const char *data, size_t length, std::string &text_out)
+{
+    const char *format;
+    if (length < sizeof(format)) {
+        return;
+    }
+    memcpy(&format, data, sizeof(format));
+    
+    size_t start = text_out.size();
+    size_t position = sizeof(format);
+    std::string string;
+    for (const char *c = format; *c != '\0'; ++c) {
+        if (*c != '%') {
+            text_out += *c;
+            continue;
+        } else if (c[1] == '%') {
+            text_out += '%';
+            ++c;
+            continue;
+        }
+        
+        const char *end = c + 1;
+        while (*end != '\0' && strchr("-+ #0123456789.", *end)) {
+            ++end;
+        }
+        std::string spec(c, std::min((size_t) (end - c), (size_t) MAX_SPEC_LENGTH));
+        while (*end != '\0' && strchr("hlLqjzt", *end)) {
+            ++end;
+        }
+        if (*end == '\0') {
+            break;
+        }
+        
+        // arguments that didn't fit in the record come out empty
+        LogRecord::ArgType type;
+        uint64_t value = 0;
+        if (__read_arg(data, length, position, type, value, string)) {
+            __format_arg(spec, *end, type, value, string, text_out);
+        }
+        c = end;
+    }
+    
+    if (text_out.size() - start > MAX_LINE_LENGTH) {
+        // mark that it was cut short
+        text_out.resize(start + MAX_LINE_LENGTH);
+        text_out.replace(text_out.size() - 3, 3, "...");
+    }
+}
+
+#pragma mark - Logger
+
+void Logger::push(int level, const LogRecord &record)
+{
+    int fd = (level >= LOG_LEVEL_ERROR ? STDERR_FILENO : STDOUT_FILENO);
+    __get_buffer().push(fd, record.get_data(), record.get_length());
+}
+
+void Logger::flush()
+{
+    __get_buffer().flush();
+}
+
+size_t Logger::get_dropped_count()
+{
+    return __get_buffer().get_dropped_count();
 }
 
 } // namespace djpi
@@ -7,17 +7,130 @@
  
 #pragma once
 
-#include "logger.h"
-#include <cstdarg>
-#include <iostream>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_NONE  3
+
+// calls below this level compile to nothing
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#define LOG_RECORD_SIZE 2048 // arguments past this are left out of the line
 
 namespace djpi {
 
+// A log call as it travels through the ring: the format pointer and a copy of each argument,
+// turned into text on the writer thread. Strings are copied, everything else is stored as a
+// 64-bit value and formatted with the conversion the format asks for.
+class LogRecord {
+public:
+    enum class ArgType : uint8_t {
+        INT,
+        UINT,
+        DOUBLE,
+        STRING,
+        POINTER
+    };
+    
+    LogRecord(const char *format);
+    
+    // appending arguments
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type append(T value)
+    {
+        if (std::is_signed<T>::value) {
+            _append_value(ArgType::INT, (uint64_t) (int64_t) value);
+        } else {
+            _append_value(ArgType::UINT, (uint64_t) value);
+        }
+    }
+    
+    template <typename T>
+    typename std::enable_if<std::is_floating_point<T>::value>::type append(T value)
+    {
+        double double_value = (double) value;
+        uint64_t bits;
+        memcpy(&bits, &double_value, sizeof(bits));
+        _append_value(ArgType::DOUBLE, bits);
+    }
+    
+    template <typename T>
+    typename std::enable_if<std::is_pointer<T>::value>::type append(T value)
+    {
+        _append_value(ArgType::POINTER, (uint64_t) (uintptr_t) value);
+    }
+    
+    void append(const char *string);
+    void append(char *string) { append((const char *) string); }
+    
+    const char* get_data() const { return _data; }
+    size_t get_length() const { return _length; }
+    
+    static void format(const char *data, size_t length, std::string &text_out); // writer thread
+
+private:
+    void _append_value(ArgType type, uint64_t value);
+
+protected:
+    char _data[LOG_RECORD_SIZE];
+    size_t _length;
+};
+
+// Log calls only copy their arguments into a record and hand it to a background writer
+// through a lock-free ring, which does the formatting and the writing, so logging costs the
+// caller no formatting and never waits on the terminal. If the ring fills up, lines are
+// dropped rather than blocking the caller. Formats must be string literals, or at least live
+// until the line has been written.
 class Logger {
 public:
-    static void log(const char *format, ...);
-    static void log_error(const char *format, ...);
-    static void logv(const char *format, va_list args, std::ostream *stream = &std::cout);
+    template <typename... Args>
+    static void log_debug(const char *format, Args... args)
+    {
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+        write(LOG_LEVEL_DEBUG, format, args...);
+#endif
+    }
+    
+    template <typename... Args>
+    static void log(const char *format, Args... args)
+    {
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+        write(LOG_LEVEL_INFO, format, args...);
+#endif
+    }
+    
+    template <typename... Args>
+    static void log_error(const char *format, Args... args)
+    {
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+        write(LOG_LEVEL_ERROR, format, args...);
+#endif
+    }
+    
+    template <typename... Args>
+    static void write(int level, const char *format, Args... args)
+    {
+        LogRecord record(format);
+        int expand[] = {0, (record.append(args), 0)...};
+        (void) expand;
+        push(level, record);
+    }
+    
+    static void push(int level, const LogRecord &record);
+    static void flush(); // blocks until everything logged so far is written
+    static size_t get_dropped_count();
 };
 
 } // namespace djpi
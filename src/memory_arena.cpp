@@ -0,0 +1,370 @@
+/*
+ * memory_arena.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "memory_arena.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fmod/fmod.hpp>
+#include <fmod/fmod_errors.h>
+#include <mutex>
+#include <sys/mman.h>
+
+#define ALIGNMENT   16
+#define FOOTER_SIZE ALIGNMENT // the block size sits in the last word, the rest keeps blocks aligned
+#define NUM_TYPES   6
+
+// padded out to ALIGNMENT so what follows it is too, on 32-bit ARM it'd otherwise be 12 bytes
+struct __attribute__((aligned(ALIGNMENT))) BlockHeader {
+    size_t size; // whole block including header and footer, low bit set while it's in use
+    unsigned requested;
+    FMOD_MEMORY_TYPE type;
+};
+
+struct FreeLinks {
+    BlockHeader *next;
+    BlockHeader *prev;
+};
+
+#define HEADER_SIZE     sizeof(BlockHeader)
+#define MIN_BLOCK_SIZE  ((HEADER_SIZE + sizeof(FreeLinks) + FOOTER_SIZE + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1))
+
+static_assert(sizeof(BlockHeader) % ALIGNMENT == 0, "block headers must keep user pointers aligned");
+static_assert(MIN_BLOCK_SIZE % ALIGNMENT == 0, "blocks must start on an ALIGNMENT boundary");
+
+static const struct {
+    FMOD_MEMORY_TYPE bit;
+    const char *name;
+} __types[NUM_TYPES] = {
+    {FMOD_MEMORY_NORMAL, "other"},
+    {FMOD_MEMORY_STREAM_FILE, "stream file"},
+    {FMOD_MEMORY_STREAM_DECODE, "stream decode"},
+    {FMOD_MEMORY_SAMPLEDATA, "sample data"},
+    {FMOD_MEMORY_DSP_OUTPUTBUFFER, "dsp output"},
+    {FMOD_MEMORY_PERSISTENT, "persistent"}
+};
+
+struct TypeCounters {
+    size_t current;
+    size_t peak;
+    size_t allocation_count;
+};
+
+struct ArenaState {
+    std::mutex lock;
+    char *base;
+    size_t budget;
+    BlockHeader *free_list;
+    size_t used;
+    size_t peak;
+    size_t allocation_count;
+    size_t failed_count;
+    TypeCounters types[NUM_TYPES];
+};
+
+// leaked, FMOD can still be freeing into it on the way out
+static ArenaState *__arena = nullptr;
+
+static size_t __block_size(const BlockHeader *block)
+{
+    return block->size & ~(size_t) 1;
+}
+
+static bool __is_used(const BlockHeader *block)
+{
+    return (block->size & 1) != 0;
+}
+
+static FreeLinks* __links(BlockHeader *block)
+{
+    return (FreeLinks *) (block + 1);
+}
+
+static void __set_block(BlockHeader *block, size_t size, bool used)
+{
+    block->size = size | (used ? 1 : 0);
+    *(size_t *) ((char *) block + size - sizeof(size_t)) = size;
+}
+
+static void __push_free(BlockHeader *block)
+{
+    FreeLinks *links = __links(block);
+    links->prev = nullptr;
+    links->next = __arena->free_list;
+    if (links->next) {
+        __links(links->next)->prev = block;
+    }
+    __arena->free_list = block;
+}
+
+static void __unlink_free(BlockHeader *block)
+{
+    FreeLinks *links = __links(block);
+    if (links->prev) {
+        __links(links->prev)->next = links->next;
+    } else {
+        __arena->free_list = links->next;
+    }
+    if (links->next) {
+        __links(links->next)->prev = links->prev;
+    }
+}
+
+static void __count(TypeCounters &counters, size_t bytes, bool allocating)
+{
+    if (allocating) {
+        counters.current += bytes;
+        counters.peak = std::max(counters.peak, counters.current);
+        ++counters.allocation_count;
+    } else {
+        counters.current -= bytes;
+        --counters.allocation_count;
+    }
+}
+
+static void __account(FMOD_MEMORY_TYPE type, size_t bytes, bool allocating)
+{
+    // an allocation can carry several bits and counts towards each, plain ones go under "other"
+    bool counted = false;
+    for (int i = 1; i < NUM_TYPES; ++i) {
+        if (type & __types[i].bit) {
+            __count(__arena->types[i], bytes, allocating);
+            counted = true;
+        }
+    }
+    if (!counted) {
+        __count(__arena->types[0], bytes, allocating);
+    }
+}
+
+static void* __alloc_locked(unsigned int size, FMOD_MEMORY_TYPE type)
+{
+    size_t needed = (size + HEADER_SIZE + FOOTER_SIZE + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1);
+    needed = std::max(needed, (size_t) MIN_BLOCK_SIZE);
+    
+    // first fit, splitting off whatever's left over if it's big enough to be a block of its own
+    for (BlockHeader *block = __arena->free_list; block; block = __links(block)->next) {
+        size_t block_size = __block_size(block);
+        if (block_size < needed) {
+            continue;
+        }
+        
+        __unlink_free(block);
+        if (block_size - needed >= MIN_BLOCK_SIZE) {
+            BlockHeader *rest = (BlockHeader *) ((char *) block + needed);
+            __set_block(rest, block_size - needed, false);
+            __push_free(rest);
+            block_size = needed;
+        }
+        
+        __set_block(block, block_size, true);
+        block->requested = size;
+        block->type = type;
+        
+        __arena->used += block_size;
+        __arena->peak = std::max(__arena->peak, __arena->used);
+        ++__arena->allocation_count;
+        __account(type, size, true);
+        return block + 1;
+    }
+    
+    ++__arena->failed_count;
+    return nullptr;
+}
+
+static void __free_locked(void *ptr)
+{
+    BlockHeader *block = (BlockHeader *) ptr - 1;
+    size_t size = __block_size(block);
+    
+    __arena->used -= size;
+    --__arena->allocation_count;
+    __account(block->type, block->requested, false);
+    
+    // merge with free neighbours on either side so the arena doesn't splinter
+    BlockHeader *next = (BlockHeader *) ((char *) block + size);
+    if ((char *) next < __arena->base + __arena->budget && !__is_used(next)) {
+        __unlink_free(next);
+        size += __block_size(next);
+    }
+    if ((char *) block > __arena->base) {
+        size_t prev_size = *(size_t *) ((char *) block - sizeof(size_t));
+        BlockHeader *prev = (BlockHeader *) ((char *) block - prev_size);
+        if (!__is_used(prev)) {
+            __unlink_free(prev);
+            size += prev_size;
+            block = prev;
+        }
+    }
+    
+    __set_block(block, size, false);
+    __push_free(block);
+}
+
+static void __log_failure(size_t failed_count)
+{
+    // only the first time, FMOD will keep asking
+    if (failed_count == 1) {
+        djpi::Logger::log_error("Warning: FMOD ran out of its %zu MB memory budget.", __arena->budget / (1024 * 1024));
+    }
+}
+
+static void* F_CALLBACK __alloc(unsigned int size, FMOD_MEMORY_TYPE type, const char *sourcestr)
+{
+    size_t failed_count;
+    void *ptr;
+    {
+        std::lock_guard<std::mutex> lock(__arena->lock);
+        ptr = __alloc_locked(size, type);
+        failed_count = __arena->failed_count;
+    }
+    
+    if (!ptr) {
+        __log_failure(failed_count);
+    }
+    return ptr;
+}
+
+static void* F_CALLBACK __realloc(void *ptr, unsigned int size, FMOD_MEMORY_TYPE type, const char *sourcestr)
+{
+    if (!ptr) {
+        return __alloc(size, type, sourcestr);
+    }
+    
+    size_t failed_count;
+    void *new_ptr;
+    {
+        std::lock_guard<std::mutex> lock(__arena->lock);
+        BlockHeader *block = (BlockHeader *) ptr - 1;
+        
+        // shrinking, or growing into the block's own slack, happens in place
+        if (size + HEADER_SIZE + FOOTER_SIZE <= __block_size(block)) {
+            __account(block->type, block->requested, false);
+            __account(type, size, true);
+            block->requested = size;
+            block->type = type;
+            return ptr;
+        }
+        
+        new_ptr = __alloc_locked(size, type);
+        if (new_ptr) {
+            memcpy(new_ptr, ptr, std::min(size, block->requested));
+            __free_locked(ptr);
+        }
+        failed_count = __arena->failed_count;
+    }
+    
+    // like realloc, the old block is left alone when there's no room for the new one
+    if (!new_ptr) {
+        __log_failure(failed_count);
+    }
+    return new_ptr;
+}
+
+static void F_CALLBACK __free(void *ptr, FMOD_MEMORY_TYPE type, const char *sourcestr)
+{
+    if (ptr) {
+        std::lock_guard<std::mutex> lock(__arena->lock);
+        __free_locked(ptr);
+    }
+}
+
+namespace djpi {
+
+double MemoryStats::get_fragmentation() const
+{
+    size_t free = budget - used;
+    return (free == 0 ? 0.0 : 1.0 - (double) largest_free / (double) free);
+}
+
+bool MemoryArena::install(size_t budget)
+{
+    if (__arena) {
+        return true;
+    }
+    
+    // the pages are only backed as FMOD first touches them
+    budget &= ~(size_t) (ALIGNMENT - 1);
+    void *base = mmap(NULL, budget, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+    if (budget < MIN_BLOCK_SIZE || base == MAP_FAILED) {
+        Logger::log_error("Warning: couldn't reserve %zu MB for FMOD, using the system heap.", budget / (1024 * 1024));
+        return false;
+    }
+    
+    ArenaState *arena = new ArenaState;
+    arena->base = (char *) base;
+    arena->budget = budget;
+    arena->free_list = nullptr;
+    arena->used = 0;
+    arena->peak = 0;
+    arena->allocation_count = 0;
+    arena->failed_count = 0;
+    memset(arena->types, 0, sizeof(arena->types));
+    __arena = arena;
+    
+    BlockHeader *block = (BlockHeader *) arena->base;
+    __set_block(block, budget, false);
+    __push_free(block);
+    
+    FMOD_RESULT result = FMOD::Memory_Initialize(nullptr, 0, __alloc, __realloc, __free, FMOD_MEMORY_ALL);
+    if (result != FMOD_OK) {
+        Logger::log_error("Warning: couldn't give FMOD its own memory (%s), using the system heap.", FMOD_ErrorString(result));
+        __arena = nullptr;
+        munmap(base, budget);
+        delete arena;
+        return false;
+    }
+    return true;
+}
+
+bool MemoryArena::is_installed()
+{
+    return (__arena != nullptr);
+}
+
+MemoryStats MemoryArena::get_stats()
+{
+    MemoryStats stats;
+    memset(&stats, 0, sizeof(stats));
+    if (!__arena) {
+        return stats;
+    }
+    
+    std::lock_guard<std::mutex> lock(__arena->lock);
+    stats.budget = __arena->budget;
+    stats.used = __arena->used;
+    stats.peak = __arena->peak;
+    stats.allocation_count = __arena->allocation_count;
+    stats.failed_count = __arena->failed_count;
+    for (BlockHeader *block = __arena->free_list; block; block = __links(block)->next) {
+        stats.largest_free = std::max(stats.largest_free, __block_size(block));
+        ++stats.free_blocks;
+    }
+    return stats;
+}
+
+std::vector<MemoryTypeStats> MemoryArena::get_type_stats()
+{
+    std::vector<MemoryTypeStats> type_stats;
+    if (!__arena) {
+        return type_stats;
+    }
+    
+    std::lock_guard<std::mutex> lock(__arena->lock);
+    for (int i = 0; i < NUM_TYPES; ++i) {
+        MemoryTypeStats stats;
+        stats.name = __types[i].name;
+        stats.current = __arena->types[i].current;
+        stats.peak = __arena->types[i].peak;
+        stats.allocation_count = __arena->types[i].allocation_count;
+        type_stats.push_back(stats);
+    }
+    return type_stats;
+}
+
+} // namespace djpi
@@ -0,0 +1,46 @@
+/*
+ * memory_arena.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+namespace djpi {
+
+struct MemoryStats {
+    size_t budget;
+    size_t used; // including block overhead
+    size_t peak;
+    size_t largest_free; // biggest free block, a little more than the largest allocation that could succeed
+    size_t free_blocks;
+    size_t allocation_count;
+    size_t failed_count;
+    
+    double get_fragmentation() const; // 0.0 when all free space is one block, towards 1.0 as it splinters
+};
+
+struct MemoryTypeStats {
+    const char *name;
+    size_t current; // bytes requested by FMOD, without overhead
+    size_t peak;
+    size_t allocation_count;
+};
+
+// A fixed budget of memory FMOD allocates everything from instead of the system heap, so a
+// player left running for days can't grow without bound, and what it holds can be told
+// apart by what FMOD said it was for.
+class MemoryArena {
+public:
+    static bool install(size_t budget); // before any FMOD system is created
+    static bool is_installed();
+    
+    static MemoryStats get_stats();
+    static std::vector<MemoryTypeStats> get_type_stats(); // one per FMOD_MEMORY_TYPE bit
+};
+
+} // namespace djpi
@@ -0,0 +1,94 @@
+/*
+ * mpeg_header.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "mpeg_header.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace djpi {
+
+bool MpegHeader::parse(const unsigned char *bytes)
+{
+    static const unsigned short __bitrates[2][3][15] = {
+        { // MPEG 1, layers I, II and III
+            {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+            {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320}
+        },
+        { // MPEG 2 and 2.5
+            {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+            {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160}
+        }
+    };
+    static const unsigned int __frequencies[3] = {44100, 48000, 32000};
+    
+    if (bytes[0] != 0xFF || (bytes[1] & 0xE0) != 0xE0) {
+        return false;
+    }
+    
+    // free format frames (bitrate 0) have no size we could work out, those files are left to FMOD
+    unsigned int version_bits = (bytes[1] >> 3) & 3;
+    unsigned int layer_bits = (bytes[1] >> 1) & 3;
+    unsigned int bitrate_index = bytes[2] >> 4;
+    unsigned int frequency_index = (bytes[2] >> 2) & 3;
+    if (version_bits == 1 || layer_bits == 0 || bitrate_index == 0 || bitrate_index == 15 || frequency_index == 3) {
+        return false;
+    }
+    
+    bool mpeg1 = (version_bits == 3);
+    unsigned int padding = (bytes[2] >> 1) & 1;
+    version = version_bits;
+    layer = 4 - layer_bits;
+    channels = ((bytes[3] >> 6) == 3 ? 1 : 2);
+    bitrate = __bitrates[mpeg1 ? 0 : 1][layer - 1][bitrate_index] * 1000;
+    frequency = __frequencies[frequency_index] >> (mpeg1 ? 0 : (version == 2 ? 1 : 2));
+    if (layer == 1) {
+        samples = 384;
+        size = (12 * bitrate / frequency + padding) * 4;
+    } else if (layer == 2 || mpeg1) {
+        samples = 1152;
+        size = 144 * bitrate / frequency + padding;
+    } else {
+        samples = 576;
+        size = 72 * bitrate / frequency + padding;
+    }
+    return true;
+}
+
+bool MpegHeader::is_same_stream(const MpegHeader &other) const
+{
+    return (version == other.version && layer == other.layer && frequency == other.frequency);
+}
+
+size_t MpegHeader::get_info_offset() const
+{
+    if (version == 3) {
+        return 4 + (channels == 1 ? 17 : 32);
+    }
+    return 4 + (channels == 1 ? 9 : 17);
+}
+
+#pragma mark - Static Methods
+
+size_t MpegHeader::get_id3v2_size(const unsigned char *bytes, size_t length)
+{
+    if (length < 10 || memcmp(bytes, "ID3", 3) != 0) {
+        return 0;
+    }
+    
+    // sizes are stored 7 bits to a byte so they never look like a frame sync
+    size_t size = ((size_t) (bytes[6] & 0x7F) << 21) | ((bytes[7] & 0x7F) << 14) | ((bytes[8] & 0x7F) << 7) | (bytes[9] & 0x7F);
+    size += 10;
+    if (bytes[5] & 0x10) {
+        size += 10; // footer
+    }
+    return size;
+}
+
+} // namespace djpi
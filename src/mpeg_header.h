@@ -0,0 +1,32 @@
+/*
+ * mpeg_header.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <cstddef>
+
+namespace djpi {
+
+// The four bytes in front of every MPEG audio frame, which is all there is to go on for
+// finding frames in an MP3 without decoding it.
+struct MpegHeader {
+    unsigned int version; // 3 for MPEG 1, 2 for MPEG 2, 0 for MPEG 2.5
+    unsigned int layer;
+    unsigned int channels;
+    unsigned int bitrate; // bits per second
+    unsigned int frequency;
+    unsigned int samples; // PCM samples in the frame
+    unsigned int size; // bytes, header included
+    
+    bool parse(const unsigned char *bytes); // false if they aren't a frame header we can size
+    bool is_same_stream(const MpegHeader &other) const;
+    size_t get_info_offset() const; // where a Xing or Info tag starts, past the side info
+    
+    static size_t get_id3v2_size(const unsigned char *bytes, size_t length); // 0 if there's no tag
+};
+
+} // namespace djpi
@@ -0,0 +1,67 @@
+/*
+ * pcm_ring_buffer.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "pcm_ring_buffer.h"
+
+#include <algorithm>
+#include <cstring>
+
+static size_t __next_power_of_two(size_t value)
+{
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+namespace djpi {
+
+PCMRingBuffer::PCMRingBuffer(size_t capacity) :
+    _buffer(__next_power_of_two(capacity)),
+    _mask(_buffer.size() - 1),
+    _write_position(0),
+    _read_position(0)
+{}
+
+size_t PCMRingBuffer::write(const void *data, size_t length)
+{
+    size_t write_position = _write_position.load(std::memory_order_relaxed);
+    size_t read_position = _read_position.load(std::memory_order_acquire);
+    length = std::min(length, _buffer.size() - (write_position - read_position));
+    
+    // copy in up to two pieces, around the end of the buffer
+    size_t offset = write_position & _mask;
+    size_t first = std::min(length, _buffer.size() - offset);
+    memcpy(&_buffer[offset], data, first);
+    memcpy(&_buffer[0], (const char *) data + first, length - first);
+    
+    _write_position.store(write_position + length, std::memory_order_release);
+    return length;
+}
+
+size_t PCMRingBuffer::read(void *data, size_t length)
+{
+    size_t read_position = _read_position.load(std::memory_order_relaxed);
+    size_t write_position = _write_position.load(std::memory_order_acquire);
+    length = std::min(length, write_position - read_position);
+    
+    size_t offset = read_position & _mask;
+    size_t first = std::min(length, _buffer.size() - offset);
+    memcpy(data, &_buffer[offset], first);
+    memcpy((char *) data + first, &_buffer[0], length - first);
+    
+    _read_position.store(read_position + length, std::memory_order_release);
+    return length;
+}
+
+size_t PCMRingBuffer::get_available() const
+{
+    return _write_position.load(std::memory_order_acquire) - _read_position.load(std::memory_order_acquire);
+}
+
+} // namespace djpi
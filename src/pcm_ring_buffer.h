@@ -0,0 +1,36 @@
+/*
+ * pcm_ring_buffer.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace djpi {
+
+// Single producer, single consumer byte ring. The decoder thread writes and FMOD's stream
+// thread reads, neither ever waits on the other.
+class PCMRingBuffer {
+public:
+    PCMRingBuffer(size_t capacity); // rounded up to a power of two
+    
+    size_t write(const void *data, size_t length); // producer only, returns bytes written
+    size_t read(void *data, size_t length); // consumer only, returns bytes read
+    
+    size_t get_capacity() const { return _buffer.size(); }
+    size_t get_available() const; // bytes waiting to be read
+    size_t get_free() const { return get_capacity() - get_available(); }
+
+protected:
+    std::vector<char> _buffer;
+    size_t _mask;
+    std::atomic<size_t> _write_position;
+    std::atomic<size_t> _read_position;
+};
+
+} // namespace djpi
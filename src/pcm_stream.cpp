@@ -0,0 +1,342 @@
+/*
+ * pcm_stream.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "pcm_stream.h"
+#include "logger.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fmod/fmod_errors.h>
+#include <thread>
+#include <vector>
+
+#define DECODE_CHUNK_MS     50
+#define DECODE_POLL_MS      10
+#define MIN_BUFFER_MS       200
+#define OPEN_ENDED_LENGTH   0xFFFFFFFE // bytes, the largest length FMOD doesn't read as unknown
+
+static FMOD_RESULT F_CALLBACK __pcm_read_callback(FMOD_SOUND *sound, void *data, unsigned int datalen);
+
+static std::atomic<int> __running_decoders(0);
+
+namespace djpi {
+
+PCMStream::PCMStream(FMOD::System *system, const std::string &filename, unsigned buffer_ms, std::shared_ptr<const TrackHead> head,
+                     unsigned length_ms) :
+    _system(system),
+    _sound(nullptr),
+    _filename(filename),
+    _buffer_ms(std::max(buffer_ms, (unsigned) MIN_BUFFER_MS)),
+    _length_ms(length_ms),
+    _state(State::OPENING),
+    _format(FMOD_SOUND_FORMAT_NONE),
+    _channels(0),
+    _frame_size(0),
+    _frequency(0.f),
+    _length(0),
+    _head(head),
+    _head_position(0),
+    _opened(false),
+    _failed(false),
+    _finished(false),
+    _closed(false),
+    _exhausted(false),
+    _decoded_bytes(0),
+    _lowest_available(0),
+    _underrun_count(0)
+{
+    if (_head) {
+        // the format is already known, so the sound can go as soon as it's asked for
+        _format = _head->format;
+        _channels = _head->channels;
+        _frame_size = _head->frame_size;
+        _frequency = _head->frequency;
+        _length = _head->length;
+        if (_length == 0 && _length_ms > 0) {
+            _length = get_pcm_length(_length_ms, _frequency, _frame_size);
+        }
+        _create_ring();
+    }
+}
+
+PCMStream::~PCMStream()
+{}
+
+std::shared_ptr<PCMStream> PCMStream::open(FMOD::System *system, const std::string &filename, unsigned buffer_ms,
+                                           std::shared_ptr<const TrackHead> head, unsigned length_ms)
+{
+    // the decoder thread holds its own reference, so closing never has to wait on a stalled read
+    std::shared_ptr<PCMStream> stream(new PCMStream(system, filename, buffer_ms, head, length_ms));
+    __running_decoders.fetch_add(1);
+    std::thread(&PCMStream::_decoder_main, stream.get(), stream).detach();
+    return stream;
+}
+
+void PCMStream::wait_for_decoders()
+{
+    while (__running_decoders.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(DECODE_POLL_MS));
+    }
+}
+
+unsigned int PCMStream::get_pcm_length(unsigned length_ms, float frequency, int frame_size)
+{
+    return (unsigned int) ((unsigned long long) length_ms * (unsigned long long) frequency / 1000) * frame_size;
+}
+
+#pragma mark - Updating
+
+void PCMStream::update()
+{
+    if (_state != State::OPENING) {
+        return;
+    }
+    
+    if (_failed.load()) {
+        _state = State::FAILED;
+    } else if (_opened.load()) {
+        // hold off until half the ring is full, so playback starts with some slack in hand.
+        // a head is slack enough on its own.
+        bool finished = _finished.load();
+        if (_head || finished || _ring->get_available() >= _ring->get_capacity() / 2) {
+            _create_sound();
+        }
+    }
+}
+
+void PCMStream::close()
+{
+    if (_sound) {
+        _sound->release();
+        _sound = nullptr;
+    }
+    _closed.store(true);
+    _state = State::FAILED;
+}
+
+#pragma mark - Statistics
+
+unsigned int PCMStream::get_decoded_length() const
+{
+    if (!_finished.load() || _failed.load() || _frame_size <= 0) {
+        return 0;
+    }
+    return (unsigned int) (_decoded_bytes.load() / _frame_size);
+}
+
+float PCMStream::get_fill_level() const
+{
+    if (!_opened.load()) {
+        return 0.f;
+    }
+    return (float) _ring->get_available() / _ring->get_capacity();
+}
+
+float PCMStream::get_lowest_fill_level() const
+{
+    if (!_opened.load()) {
+        return 0.f;
+    }
+    return (float) _lowest_available.load() / _ring->get_capacity();
+}
+
+#pragma mark - Callbacks
+
+void PCMStream::read_callback(void *data, unsigned int length)
+{
+    // called on FMOD's stream thread. the head goes first, then the ring picks up where it ends.
+    if (_head && _head_position < _head->data.size()) {
+        size_t head_length = std::min((size_t) length, _head->data.size() - _head_position);
+        memcpy(data, &_head->data[_head_position], head_length);
+        _head_position += head_length;
+        data = (char *) data + head_length;
+        length -= (unsigned int) head_length;
+        if (length == 0) {
+            return;
+        }
+    }
+    
+    // only whole frames are taken so channels never slip. finished is checked before the ring is
+    // read, so a short read after that really is the end of what the decoder produced.
+    bool finished = _finished.load();
+    size_t available = _ring->get_available();
+    if (available < _lowest_available.load(std::memory_order_relaxed)) {
+        _lowest_available.store(available, std::memory_order_relaxed);
+    }
+    
+    size_t read_length = std::min((size_t) length, available);
+    read_length -= read_length % _frame_size;
+    read_length = _ring->read(data, read_length);
+    
+    if (read_length < length) {
+        // past the end of what was decoded this is only padding up to the length FMOD was given,
+        // which may be open-ended or a file that was cut short. the engine ends the track instead.
+        memset((char *) data + read_length, 0, length - read_length);
+        if (finished) {
+            _exhausted.store(true);
+        } else {
+            _underrun_count.fetch_add(1);
+        }
+    }
+}
+
+#pragma mark - Internal
+
+void PCMStream::_decoder_main(std::shared_ptr<PCMStream> self)
+{
+    // FMOD_ACCURATETIME would scan the whole file before the first sample. the user sound's length
+    // comes from the seek index instead, or is left open until the decoder finds the end.
+    FMOD_MODE mode = FMOD_OPENONLY | FMOD_CREATESTREAM;
+    FMOD::Sound *source = nullptr;
+    FMOD_RESULT result = _system->createSound(_filename.c_str(), mode, NULL, &source);
+    if (result != FMOD_OK || !(_head ? _skip_head(source) : _read_format(source))) {
+        if (result != FMOD_OK) {
+            Logger::log_error("Unable to decode %s: %s", _filename.c_str(), FMOD_ErrorString(result));
+        }
+        if (source) {
+            source->release();
+        }
+        _failed.store(true);
+        _finished.store(true);
+        __running_decoders.fetch_sub(1);
+        return;
+    }
+    
+    if (!_head) {
+        _create_ring();
+    }
+    size_t decoded_bytes = (_head ? _head->data.size() : 0);
+    
+    size_t frame_rate_bytes = (size_t) _frequency * _frame_size;
+    std::vector<char> chunk(std::max(frame_rate_bytes * DECODE_CHUNK_MS / 1000 / _frame_size, (size_t) 1) * _frame_size);
+    while (!_closed.load()) {
+        if (_ring->get_free() < chunk.size()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(DECODE_POLL_MS));
+            continue;
+        }
+        
+        unsigned int read = 0;
+        result = source->readData(&chunk[0], (unsigned int) chunk.size(), &read);
+        if (read > 0) {
+            _ring->write(&chunk[0], read);
+            decoded_bytes += read;
+        }
+        if (result != FMOD_OK) {
+            if (result != FMOD_ERR_FILE_EOF) {
+                Logger::log_error("Error decoding %s: %s", _filename.c_str(), FMOD_ErrorString(result));
+                _failed.store(true);
+            }
+            break;
+        }
+    }
+    
+    source->release();
+    _decoded_bytes.store(decoded_bytes);
+    _finished.store(true);
+    __running_decoders.fetch_sub(1);
+}
+
+bool PCMStream::_read_format(FMOD::Sound *source)
+{
+    int bits = 0;
+    source->getFormat(NULL, &_format, &_channels, &bits);
+    source->getDefaults(&_frequency, NULL, NULL, NULL);
+    _frame_size = _channels * bits / 8;
+    
+    // FMOD's length is only an estimate for VBR files, but without one it's a format that
+    // doesn't really end, like a module, and is better left to FMOD
+    unsigned int estimate = 0;
+    source->getLength(&estimate, FMOD_TIMEUNIT_PCMBYTES);
+    if (_frame_size <= 0 || _frequency <= 0.f || estimate == 0 || estimate == 0xFFFFFFFF) {
+        Logger::log_debug("Can't decode %s ahead of time, unknown format or length.", _filename.c_str());
+        return false;
+    }
+    
+    _length = (_length_ms > 0 ? get_pcm_length(_length_ms, _frequency, _frame_size) : 0);
+    return true;
+}
+
+bool PCMStream::_skip_head(FMOD::Sound *source)
+{
+    FMOD_SOUND_FORMAT format = FMOD_SOUND_FORMAT_NONE;
+    int channels = 0;
+    source->getFormat(NULL, &format, &channels, NULL);
+    if (format != _format || channels != _channels) {
+        Logger::log_error("Error decoding %s: the file changed since its start was cached.", _filename.c_str());
+        return false;
+    }
+    
+    // decode our way past the head rather than seeking, so the ring carries on from exactly the
+    // sample it ended on. seeking compressed formats lands on frame boundaries and loses the
+    // decoder state carried between frames.
+    std::vector<char> scratch((size_t) _frequency * DECODE_CHUNK_MS / 1000 * _frame_size);
+    size_t remaining = _head->data.size();
+    while (remaining > 0 && !_closed.load()) {
+        unsigned int read = 0;
+        FMOD_RESULT result = source->readData(&scratch[0], (unsigned int) std::min(remaining, scratch.size()), &read);
+        remaining -= std::min((size_t) read, remaining);
+        if (result == FMOD_ERR_FILE_EOF) {
+            break;
+        } else if (result != FMOD_OK) {
+            Logger::log_error("Error decoding %s: %s", _filename.c_str(), FMOD_ErrorString(result));
+            return false;
+        }
+    }
+    return true;
+}
+
+void PCMStream::_create_ring()
+{
+    size_t frame_rate_bytes = (size_t) _frequency * _frame_size;
+    _ring = std::unique_ptr<PCMRingBuffer>(new PCMRingBuffer(frame_rate_bytes * _buffer_ms / 1000));
+    _lowest_available.store(_ring->get_capacity());
+    _opened.store(true);
+}
+
+void PCMStream::_create_sound()
+{
+    FMOD_CREATESOUNDEXINFO info;
+    memset(&info, 0, sizeof(info));
+    info.cbsize = sizeof(info);
+    info.length = (_length > 0 ? _length : OPEN_ENDED_LENGTH - OPEN_ENDED_LENGTH % _frame_size);
+    info.numchannels = _channels;
+    info.defaultfrequency = (int) _frequency;
+    info.format = _format;
+    info.decodebuffersize = (unsigned int) _frequency * DECODE_CHUNK_MS / 1000;
+    info.pcmreadcallback = __pcm_read_callback;
+    info.userdata = this;
+    
+    FMOD::Sound *sound = nullptr;
+    FMOD_RESULT result = _system->createStream(NULL, FMOD_OPENUSER, &info, &sound);
+    if (result == FMOD_OK) {
+        _sound = sound;
+        _state = State::READY;
+    } else {
+        Logger::log_error("FMOD Error %d: %s", result, FMOD_ErrorString(result));
+        _closed.store(true);
+        _state = State::FAILED;
+    }
+}
+
+} // namespace djpi
+
+static FMOD_RESULT F_CALLBACK __pcm_read_callback(FMOD_SOUND *sound, void *data, unsigned int datalen)
+{
+    FMOD::Sound *cppsound = (FMOD::Sound *) sound;
+    void *userdata = nullptr;
+    
+    cppsound->getUserData(&userdata);
+    if (userdata) {
+        djpi::PCMStream *stream = (djpi::PCMStream *) userdata;
+        stream->read_callback(data, datalen);
+    } else {
+        memset(data, 0, datalen);
+    }
+    
+    return FMOD_OK;
+}
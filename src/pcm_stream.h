@@ -0,0 +1,107 @@
+/*
+ * pcm_stream.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <atomic>
+#include <fmod/fmod.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include "pcm_ring_buffer.h"
+
+namespace djpi {
+
+// The start of a track already decoded, so it can begin playing before its file is even open.
+struct TrackHead {
+    FMOD_SOUND_FORMAT format;
+    int channels;
+    int frame_size;
+    float frequency;
+    unsigned int length; // bytes of PCM in the whole track, 0 if it isn't known exactly
+    std::vector<char> data; // whole frames from the beginning of the track
+};
+
+// A track decoded ahead of time on its own thread into a PCM ring, which FMOD then plays
+// through a user stream. Disk stalls and decode jitter only drain the ring instead of
+// reaching the mixer.
+class PCMStream {
+public:
+    enum class State {
+        OPENING,
+        READY,
+        FAILED
+    };
+    
+    // starts decoding straight away, buffer_ms is the depth of the ring. with a head, the sound
+    // plays from it right away while the decoder catches up behind it.
+    // length_ms is the track's exact length if it's known. without one the sound is left open-ended
+    // and the track ends once everything decoded has played, see get_decoded_length().
+    static std::shared_ptr<PCMStream> open(FMOD::System *system, const std::string &filename, unsigned buffer_ms,
+                                           std::shared_ptr<const TrackHead> head = nullptr, unsigned length_ms = 0);
+    static unsigned int get_pcm_length(unsigned length_ms, float frequency, int frame_size); // in whole frames
+    static void wait_for_decoders(); // blocks until every closed stream's decoder has let go of FMOD
+    ~PCMStream();
+    
+    // engine thread only
+    void update(); // creates the sound once enough has been decoded
+    void close(); // releases the sound, the decoder thread finishes on its own
+    
+    // accessors
+    State get_state() const { return _state; }
+    FMOD::Sound* get_sound() const { return _sound; } // owned by the stream, valid while READY
+    bool is_exhausted() const { return _exhausted.load(); } // the decoder is done and the sound has taken all it decoded
+    bool is_failed() const { return _failed.load(); } // the decoder gave up, the rest of the track is silence
+    unsigned int get_decoded_length() const; // PCM samples in the whole track, 0 until the decoder reaches the end
+    
+    // statistics, safe from any thread
+    float get_fill_level() const; // 0.0 - 1.0
+    float get_lowest_fill_level() const; // since the sound was created
+    size_t get_underrun_count() const { return _underrun_count.load(); }
+    
+    // callbacks
+    void read_callback(void *data, unsigned int length);
+
+private:
+    PCMStream(FMOD::System *system, const std::string &filename, unsigned buffer_ms, std::shared_ptr<const TrackHead> head,
+              unsigned length_ms);
+    
+    void _decoder_main(std::shared_ptr<PCMStream> self);
+    bool _read_format(FMOD::Sound *source);
+    bool _skip_head(FMOD::Sound *source);
+    void _create_ring();
+    void _create_sound();
+
+protected:
+    FMOD::System *_system;
+    FMOD::Sound *_sound;
+    std::string _filename;
+    unsigned _buffer_ms;
+    unsigned _length_ms; // 0 if not known up front
+    State _state;
+    
+    // written by the decoder thread before _opened is set
+    std::unique_ptr<PCMRingBuffer> _ring;
+    FMOD_SOUND_FORMAT _format;
+    int _channels;
+    int _frame_size;
+    float _frequency;
+    unsigned int _length; // bytes
+    std::shared_ptr<const TrackHead> _head;
+    size_t _head_position; // stream thread only
+    
+    std::atomic<bool> _opened;
+    std::atomic<bool> _failed;
+    std::atomic<bool> _finished;
+    std::atomic<bool> _closed;
+    std::atomic<bool> _exhausted; // finished, and the ring has run dry
+    std::atomic<size_t> _decoded_bytes; // head included, complete once _finished is set
+    std::atomic<size_t> _lowest_available;
+    std::atomic<size_t> _underrun_count;
+};
+
+} // namespace djpi
@@ -0,0 +1,155 @@
+/*
+ * playlist.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "playlist.h"
+
+namespace djpi {
+
+const size_t Playlist::npos;
+
+Playlist::Playlist() :
+    _position(0),
+    _active(false),
+    _repeat(false)
+{}
+
+#pragma mark - Managing Tracks
+
+size_t Playlist::append(std::string filename, const TrackInfo &info)
+{
+    TrackHandle handle = _table.add(filename);
+    if (!info.is_empty() || info.file_size > 0) {
+        _table.set_info(handle, info);
+    }
+    _tracks.push_back(handle);
+    return _tracks.size() - 1;
+}
+
+void Playlist::clear()
+{
+    std::vector<TrackHandle>().swap(_tracks);
+    _table.clear();
+    reset();
+}
+
+void Playlist::clear_upcoming()
+{
+    size_t next = _get_next_position();
+    if (next < _tracks.size()) {
+        for (size_t i = next; i < _tracks.size(); ++i) {
+            _table.remove(_tracks[i]);
+        }
+        _tracks.erase(_tracks.begin() + next, _tracks.end());
+    }
+}
+
+size_t Playlist::remove_tracks(const std::function<bool(size_t index, TrackHandle handle)> &predicate)
+{
+    // compact in a single pass, keeping the cursor on the same track
+    size_t kept = 0;
+    size_t position = _position;
+    for (size_t i = 0; i < _tracks.size(); ++i) {
+        if (predicate(i, _tracks[i])) {
+            _table.remove(_tracks[i]);
+            if (i < _position) {
+                --position;
+            } else if (i == _position && _active) {
+                // the current track went away, the cursor now points at the one after it
+                _active = false;
+            }
+        } else {
+            _tracks[kept++] = _tracks[i];
+        }
+    }
+    
+    size_t removed = _tracks.size() - kept;
+    _tracks.erase(_tracks.begin() + kept, _tracks.end());
+    _position = position;
+    return removed;
+}
+
+#pragma mark - Cursor
+
+size_t Playlist::get_cursor() const
+{
+    return (_active ? _position : npos);
+}
+
+size_t Playlist::get_next() const
+{
+    size_t next = _get_next_position();
+    if (next >= _tracks.size()) {
+        next = (_repeat && _tracks.size() > 0 ? 0 : npos);
+    }
+    return next;
+}
+
+size_t Playlist::get_upcoming_count() const
+{
+    size_t next = _get_next_position();
+    return (next < _tracks.size() ? _tracks.size() - next : 0);
+}
+
+bool Playlist::advance(size_t count)
+{
+    if (count == 0) {
+        return _active;
+    }
+    
+    size_t target = _get_next_position() + count - 1;
+    if (target >= _tracks.size()) {
+        if (_repeat && _tracks.size() > 0) {
+            target %= _tracks.size();
+        } else {
+            // ran off the end, park the cursor after the last track
+            _position = _tracks.size();
+            _active = false;
+            return false;
+        }
+    }
+    
+    _position = target;
+    _active = true;
+    return true;
+}
+
+bool Playlist::rewind(size_t count)
+{
+    if (_position == 0 || _tracks.size() == 0) {
+        return false;
+    }
+    
+    _position -= (count < _position ? count : _position);
+    _active = true;
+    return true;
+}
+
+bool Playlist::seek(size_t index)
+{
+    if (index >= _tracks.size()) {
+        return false;
+    }
+    
+    _position = index;
+    _active = true;
+    return true;
+}
+
+void Playlist::reset()
+{
+    _position = 0;
+    _active = false;
+}
+
+#pragma mark - Internal
+
+size_t Playlist::_get_next_position() const
+{
+    return (_active ? _position + 1 : _position);
+}
+
+} // namespace djpi
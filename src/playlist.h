@@ -0,0 +1,61 @@
+/*
+ * playlist.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "track_table.h"
+
+namespace djpi {
+
+// Track handles live in one contiguous array with a cursor on the current track. Everything
+// before the cursor is history and everything after it is upcoming. The paths themselves
+// are kept in the track table.
+class Playlist {
+public:
+    static const size_t npos = (size_t) -1;
+    
+    Playlist();
+    
+    // managing tracks
+    size_t append(std::string filename, const TrackInfo &info = TrackInfo());
+    void clear();
+    void clear_upcoming();
+    size_t remove_tracks(const std::function<bool(size_t index, TrackHandle handle)> &predicate);
+    bool contains(const std::string &filename) const { return _table.find(filename) != TrackTable::invalid_handle; }
+    size_t size() const { return _tracks.size(); }
+    TrackHandle at(size_t index) const { return _tracks[index]; }
+    const TrackTable& get_table() const { return _table; }
+    
+    // cursor
+    size_t get_cursor() const;
+    size_t get_next() const;
+    size_t get_upcoming_count() const;
+    size_t get_history_count() const { return _position; }
+    bool advance(size_t count = 1);
+    bool rewind(size_t count = 1);
+    bool seek(size_t index);
+    void reset();
+    
+    // repeat
+    bool get_repeat() const { return _repeat; }
+    void set_repeat(bool repeat) { _repeat = repeat; }
+
+private:
+    size_t _get_next_position() const;
+
+protected:
+    std::vector<TrackHandle> _tracks;
+    TrackTable _table;
+    size_t _position; // current track if _active, otherwise the next one to play
+    bool _active;
+    bool _repeat;
+};
+
+} // namespace djpi
@@ -0,0 +1,398 @@
+/*
+ * seek_index.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "seek_index.h"
+#include "io_scheduler.h"
+#include "logger.h"
+#include "mpeg_header.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SEEK_MAGIC          0x4B534A44 // "DJSK"
+#define SEEK_VERSION        1
+#define SEEK_INTERVAL       8    // frames between entries, about a fifth of a second of MP3
+#define MAX_RECENT_INDEXES  8
+#define MAX_RESYNC_BYTES    4096 // junk tolerated between frames before the rest is taken to be a tag
+#define SCAN_CHUNK_SIZE     (256 * 1024)
+
+struct SeekFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t size; // of the track
+    int64_t mtime;
+    uint64_t length;
+    uint32_t frequency;
+    uint32_t frame_samples;
+    uint32_t interval;
+    uint32_t entry_count;
+    uint32_t path_length; // the path follows the header, then the offsets
+    uint32_t reserved;
+};
+
+static uint64_t __hash_path(const std::string &path)
+{
+    // FNV-1a
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < path.size(); ++i) {
+        hash ^= (unsigned char) path[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static bool __is_info_frame(const unsigned char *frame, const djpi::MpegHeader &header)
+{
+    // the Xing, Info or VBRI frame at the start only describes the file, decoders skip over it
+    const unsigned char *xing = frame + header.get_info_offset();
+    const unsigned char *vbri = frame + 4 + 32;
+    if (xing + 4 <= frame + header.size && (memcmp(xing, "Xing", 4) == 0 || memcmp(xing, "Info", 4) == 0)) {
+        return true;
+    }
+    return (vbri + 4 <= frame + header.size && memcmp(vbri, "VBRI", 4) == 0);
+}
+
+// Reads a file forward a chunk at a time with pread, so a file that shrinks or a card that's
+// pulled while it's being indexed only ends the scan early. Each chunk is background I/O of its
+// own, so a long scan keeps giving way to playback instead of only waiting once at the start.
+struct ScanReader {
+    int fd;
+    size_t size;
+    std::vector<unsigned char> buffer;
+    size_t base; // file offset of the start of the buffer
+    size_t length;
+    
+    // the bytes at [position, position + count), null past the end of the file or on an error
+    const unsigned char* get(size_t position, size_t count)
+    {
+        if (position >= base && position + count <= base + length) {
+            return buffer.data() + (position - base);
+        } else if (position + count > size) {
+            return nullptr;
+        }
+        
+        base = position;
+        length = 0;
+        size_t wanted = std::min(buffer.size(), size - position);
+        djpi::IoScheduler::wait_for_turn();
+        double start_time = djpi::IoScheduler::begin(djpi::IoScheduler::Class::BACKGROUND);
+        while (length < wanted) {
+            ssize_t result = pread(fd, buffer.data() + length, wanted - length, base + length);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            } else if (result <= 0) {
+                break;
+            }
+            length += result;
+        }
+        djpi::IoScheduler::end(djpi::IoScheduler::Class::BACKGROUND, start_time);
+        return (count <= length ? buffer.data() : nullptr);
+    }
+};
+
+static bool __scan_frames(ScanReader &reader, djpi::SeekIndex &index_out)
+{
+    // an ID3v1 tag at the end isn't audio either
+    size_t size = std::min(reader.size, (size_t) 0xFFFFFFFF);
+    const unsigned char *tag = (size >= 128 ? reader.get(size - 128, 128) : nullptr);
+    if (tag && memcmp(tag, "TAG", 3) == 0) {
+        size -= 128;
+    }
+    
+    const unsigned char *head = reader.get(0, std::min(size, (size_t) 10));
+    size_t position = (head ? std::min(djpi::MpegHeader::get_id3v2_size(head, std::min(size, (size_t) 10)), size) : size);
+    
+    // lock on to the first frame that's followed by another like it, so a stray sync pattern
+    // in cover art or junk doesn't count
+    djpi::MpegHeader first, header;
+    const unsigned char *bytes = nullptr;
+    bool found = false;
+    while (!found && position + 4 <= size) {
+        bytes = reader.get(position, 4);
+        if (!bytes) {
+            return false;
+        }
+        found = (first.parse(bytes) && position + first.size + 4 <= size &&
+                 (bytes = reader.get(position + first.size, 4)) && header.parse(bytes) && first.is_same_stream(header));
+        if (!found) {
+            ++position;
+        }
+    }
+    if (!found) {
+        return false;
+    }
+    
+    bytes = reader.get(position, first.size);
+    if (bytes && __is_info_frame(bytes, first)) {
+        position += first.size;
+    }
+    
+    index_out.frequency = first.frequency;
+    index_out.frame_samples = first.samples;
+    index_out.interval = SEEK_INTERVAL;
+    index_out.offsets.clear();
+    
+    size_t frame_count = 0;
+    size_t skipped = 0;
+    while (position + 4 <= size && skipped <= MAX_RESYNC_BYTES) {
+        bytes = reader.get(position, 4);
+        if (!bytes) {
+            break;
+        } else if (!header.parse(bytes) || !first.is_same_stream(header)) {
+            ++position;
+            ++skipped;
+            continue;
+        } else if (position + header.size > size) {
+            // cut off part way through
+            break;
+        }
+        
+        if (frame_count % SEEK_INTERVAL == 0) {
+            index_out.offsets.push_back((uint32_t) position);
+        }
+        ++frame_count;
+        position += header.size;
+        skipped = 0;
+    }
+    
+    index_out.length = (unsigned long long) frame_count * first.samples;
+    return (frame_count > 0);
+}
+
+static std::shared_ptr<const djpi::SeekIndex> __build_index(const std::string &filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    
+    struct stat s;
+    if (fstat(fd, &s) != 0 || s.st_size == 0) {
+        close(fd);
+        return nullptr;
+    }
+    
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    ScanReader reader = {fd, (size_t) s.st_size, std::vector<unsigned char>(SCAN_CHUNK_SIZE), 0, 0};
+    std::shared_ptr<djpi::SeekIndex> index(new djpi::SeekIndex);
+    bool found = __scan_frames(reader, *index);
+    close(fd);
+    return (found ? index : nullptr);
+}
+
+namespace djpi {
+
+size_t SeekIndex::find_entry(unsigned long long position) const
+{
+    size_t entry = (size_t) (position / ((unsigned long long) interval * frame_samples));
+    return std::min(entry, offsets.size() - 1);
+}
+
+SeekIndexer::SeekIndexer(std::string directory) :
+    _directory(directory),
+    _running(true)
+{
+    _thread = std::thread(&SeekIndexer::_worker_main, this);
+}
+
+SeekIndexer::~SeekIndexer()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _running = false;
+    }
+    _cond.notify_all();
+    _thread.join();
+}
+
+void SeekIndexer::request(const std::string &filename)
+{
+    if (!supports_filename(filename)) {
+        return;
+    }
+    
+    std::lock_guard<std::mutex> lock(_lock);
+    auto recent = std::find(_recent.begin(), _recent.end(), filename);
+    if (recent != _recent.end()) {
+        _recent.erase(recent);
+        _recent.push_back(filename);
+        return;
+    }
+    
+    _recent.push_back(filename);
+    _indexes[filename] = nullptr;
+    _pending.push_back(filename);
+    
+    // they're cheap to load again from disk, only the tracks around the cursor are kept
+    while (_recent.size() > MAX_RECENT_INDEXES) {
+        std::string dropped = _recent.front();
+        _recent.pop_front();
+        _indexes.erase(dropped);
+        _pending.erase(std::remove(_pending.begin(), _pending.end(), dropped), _pending.end());
+    }
+    _cond.notify_all();
+}
+
+std::shared_ptr<const SeekIndex> SeekIndexer::find(const std::string &filename)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    auto itr = _indexes.find(filename);
+    return (itr != _indexes.end() ? itr->second : nullptr);
+}
+
+#pragma mark - Static Methods
+
+bool SeekIndexer::supports_filename(const std::string &filename)
+{
+    // the other formats FMOD plays either seek exactly already or are loaded whole
+    std::string extension = Util::filename_ext(filename);
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::toupper);
+    return (extension == "MP3" || extension == "MP2");
+}
+
+std::string SeekIndexer::default_directory()
+{
+    const char *home = getenv("HOME");
+    return (home ? std::string(home) + "/.djpi/seek" : std::string());
+}
+
+#pragma mark - Internal
+
+void SeekIndexer::_worker_main()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    while (_running) {
+        if (_pending.empty()) {
+            _cond.wait(lock);
+            continue;
+        }
+        
+        std::string filename = _pending.front();
+        _pending.pop_front();
+        lock.unlock();
+        
+        std::shared_ptr<const SeekIndex> index;
+        struct stat s;
+        if (stat(filename.c_str(), &s) == 0) {
+            index = _load(filename, s.st_size, s.st_mtime);
+            if (!index) {
+                // reading the whole file is background work, each chunk waits for its turn
+                double start_time = Util::current_time();
+                index = __build_index(filename);
+                if (index) {
+                    Logger::log_debug("Indexed %s: %zu seek points in %.1f ms.", Util::basename(filename).c_str(),
+                                      index->offsets.size(), (Util::current_time() - start_time) * 1000.0);
+                    _save(filename, s.st_size, s.st_mtime, *index);
+                }
+            }
+        }
+        
+        // it may have been dropped while we were busy
+        lock.lock();
+        auto itr = _indexes.find(filename);
+        if (itr != _indexes.end()) {
+            itr->second = index;
+        }
+    }
+}
+
+std::shared_ptr<const SeekIndex> SeekIndexer::_load(const std::string &filename, uint64_t size, int64_t mtime)
+{
+    if (_directory.empty()) {
+        return nullptr;
+    }
+    
+    FILE *file = fopen(_get_cache_filename(filename).c_str(), "rb");
+    if (!file) {
+        return nullptr;
+    }
+    
+    // a different size or modification time means the track has changed since it was indexed
+    SeekFileHeader header;
+    std::string path(filename.size(), '\0');
+    bool valid = (fread(&header, sizeof(header), 1, file) == 1 &&
+                  header.magic == SEEK_MAGIC && header.version == SEEK_VERSION &&
+                  header.size == size && header.mtime == mtime && header.path_length == filename.size() &&
+                  header.frequency > 0 && header.frame_samples > 0 && header.interval > 0 &&
+                  header.entry_count > 0 && header.entry_count <= size &&
+                  (path.empty() || fread(&path[0], 1, path.size(), file) == path.size()) && path == filename);
+    
+    std::shared_ptr<SeekIndex> index;
+    if (valid) {
+        index = std::shared_ptr<SeekIndex>(new SeekIndex);
+        index->frequency = header.frequency;
+        index->frame_samples = header.frame_samples;
+        index->interval = header.interval;
+        index->length = header.length;
+        index->offsets.resize(header.entry_count);
+        valid = (fread(index->offsets.data(), sizeof(uint32_t), index->offsets.size(), file) == index->offsets.size());
+    }
+    fclose(file);
+    
+    return (valid ? index : nullptr);
+}
+
+void SeekIndexer::_save(const std::string &filename, uint64_t size, int64_t mtime, const SeekIndex &index)
+{
+    if (_directory.empty()) {
+        return;
+    }
+    
+    SeekFileHeader header = {0};
+    header.magic = SEEK_MAGIC;
+    header.version = SEEK_VERSION;
+    header.size = size;
+    header.mtime = mtime;
+    header.length = index.length;
+    header.frequency = index.frequency;
+    header.frame_samples = index.frame_samples;
+    header.interval = index.interval;
+    header.entry_count = (uint32_t) index.offsets.size();
+    header.path_length = (uint32_t) filename.size();
+    
+    // written next to the old one and swapped in, so a crash never leaves a torn file
+    mkdir(Util::dirname(_directory).c_str(), 0755);
+    mkdir(_directory.c_str(), 0755);
+    std::string cache_filename = _get_cache_filename(filename);
+    std::string tmp_filename = cache_filename + ".tmp";
+    FILE *file = fopen(tmp_filename.c_str(), "wb");
+    if (!file) {
+        Logger::log_error("Warning: cannot write seek index %s.", tmp_filename.c_str());
+        return;
+    }
+    
+    bool success = (fwrite(&header, sizeof(header), 1, file) == 1);
+    success = success && fwrite(filename.data(), 1, filename.size(), file) == filename.size();
+    success = success && fwrite(index.offsets.data(), sizeof(uint32_t), index.offsets.size(), file) == index.offsets.size();
+    success = (fclose(file) == 0) && success;
+    
+    if (success) {
+        success = (rename(tmp_filename.c_str(), cache_filename.c_str()) == 0);
+    }
+    if (!success) {
+        Logger::log_error("Warning: cannot write seek index %s.", cache_filename.c_str());
+        unlink(tmp_filename.c_str());
+    }
+}
+
+std::string SeekIndexer::_get_cache_filename(const std::string &filename) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.idx", (unsigned long long) __hash_path(filename));
+    return _directory + "/" + name;
+}
+
+} // namespace djpi
@@ -0,0 +1,68 @@
+/*
+ * seek_index.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace djpi {
+
+// Where every few MPEG frames of a file start, so a seek can go straight to the right byte
+// without FMOD_ACCURATETIME scanning the whole file when it opens.
+struct SeekIndex {
+    unsigned int frequency;
+    unsigned int frame_samples; // PCM samples per frame
+    unsigned int interval; // frames between entries
+    unsigned long long length; // PCM samples in the whole file
+    std::vector<uint32_t> offsets; // byte offset of every interval'th audio frame
+    
+    unsigned long long get_entry_position(size_t entry) const { return (unsigned long long) entry * interval * frame_samples; }
+    size_t find_entry(unsigned long long position) const; // the last entry at or before the position
+};
+
+// Builds seek indexes on a background thread and keeps them on disk, one small file per
+// track keyed by its path, size and modification time, so a file is only ever scanned once.
+class SeekIndexer {
+public:
+    SeekIndexer(std::string directory);
+    SeekIndexer(const SeekIndexer&) = delete;
+    ~SeekIndexer();
+    
+    // engine thread
+    void request(const std::string &filename); // no-op for files that don't need an index
+    std::shared_ptr<const SeekIndex> find(const std::string &filename); // null until it's built
+    
+    static bool supports_filename(const std::string &filename);
+    static std::string default_directory();
+
+private:
+    void _worker_main();
+    std::shared_ptr<const SeekIndex> _load(const std::string &filename, uint64_t size, int64_t mtime);
+    void _save(const std::string &filename, uint64_t size, int64_t mtime, const SeekIndex &index);
+    std::string _get_cache_filename(const std::string &filename) const;
+
+protected:
+    std::string _directory;
+    std::thread _thread;
+    bool _running;
+    
+    std::mutex _lock;
+    std::condition_variable _cond;
+    std::deque<std::string> _pending;
+    std::deque<std::string> _recent; // filenames we hold indexes for, most recent last
+    std::map<std::string, std::shared_ptr<const SeekIndex>> _indexes; // null while building or if the file has none
+};
+
+} // namespace djpi
@@ -0,0 +1,634 @@
+/*
+ * tag_reader.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "tag_reader.h"
+#include "mpeg_header.h"
+#include "util.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+#define HEAD_READ_SIZE      (64 * 1024) // the tags in front of nearly every file, unless there's cover art
+#define TAIL_READ_SIZE      (16 * 1024) // enough to hold the last Ogg page
+#define FRAME_READ_SIZE     4096        // an MP3's first frame, when it's past the head
+#define MAX_BLOCK_SIZE      (64 * 1024) // largest comment or chunk read on its own
+#define MAX_CHUNK_COUNT     32
+#define MAX_FIELD_LENGTH    255
+
+struct TagFile {
+    int fd;
+    uint64_t size;
+    std::vector<unsigned char> head;
+    std::vector<unsigned char> scratch; // anything read from past the head
+};
+
+#pragma mark - Reading
+
+static bool __read_at(int fd, uint64_t offset, size_t length, std::vector<unsigned char> &buffer_out)
+{
+    buffer_out.resize(length);
+    size_t done = 0;
+    while (done < length) {
+        ssize_t result = pread(fd, buffer_out.data() + done, length - done, offset + done);
+        if (result < 0 && errno == EINTR) {
+            continue;
+        } else if (result <= 0) {
+            break;
+        }
+        done += result;
+    }
+    buffer_out.resize(done);
+    return (done == length);
+}
+
+static const unsigned char* __get_bytes(TagFile &file, uint64_t offset, size_t length)
+{
+    // straight out of the head when we have it, otherwise one more bounded read
+    if (offset + length <= file.head.size()) {
+        return file.head.data() + offset;
+    }
+    if (length > MAX_BLOCK_SIZE || offset + length > file.size || !__read_at(file.fd, offset, length, file.scratch)) {
+        return nullptr;
+    }
+    return file.scratch.data();
+}
+
+static uint32_t __read_be32(const unsigned char *bytes)
+{
+    return ((uint32_t) bytes[0] << 24) | ((uint32_t) bytes[1] << 16) | ((uint32_t) bytes[2] << 8) | bytes[3];
+}
+
+static uint32_t __read_le32(const unsigned char *bytes)
+{
+    return ((uint32_t) bytes[3] << 24) | ((uint32_t) bytes[2] << 16) | ((uint32_t) bytes[1] << 8) | bytes[0];
+}
+
+static uint32_t __read_syncsafe32(const unsigned char *bytes)
+{
+    return ((uint32_t) (bytes[0] & 0x7F) << 21) | ((bytes[1] & 0x7F) << 14) | ((bytes[2] & 0x7F) << 7) | (bytes[3] & 0x7F);
+}
+
+#pragma mark - Text
+
+static void __append_utf8(std::string &str, uint32_t codepoint)
+{
+    if (codepoint < 0x80) {
+        str += (char) codepoint;
+    } else if (codepoint < 0x800) {
+        str += (char) (0xC0 | (codepoint >> 6));
+        str += (char) (0x80 | (codepoint & 0x3F));
+    } else if (codepoint < 0x10000) {
+        str += (char) (0xE0 | (codepoint >> 12));
+        str += (char) (0x80 | ((codepoint >> 6) & 0x3F));
+        str += (char) (0x80 | (codepoint & 0x3F));
+    } else {
+        str += (char) (0xF0 | (codepoint >> 18));
+        str += (char) (0x80 | ((codepoint >> 12) & 0x3F));
+        str += (char) (0x80 | ((codepoint >> 6) & 0x3F));
+        str += (char) (0x80 | (codepoint & 0x3F));
+    }
+}
+
+static std::string __decode_latin1(const unsigned char *bytes, size_t length)
+{
+    std::string str;
+    for (size_t i = 0; i < length && bytes[i] != 0; ++i) {
+        __append_utf8(str, bytes[i]);
+    }
+    return str;
+}
+
+static std::string __decode_utf16(const unsigned char *bytes, size_t length, bool big_endian)
+{
+    if (length >= 2 && ((bytes[0] == 0xFF && bytes[1] == 0xFE) || (bytes[0] == 0xFE && bytes[1] == 0xFF))) {
+        big_endian = (bytes[0] == 0xFE);
+        bytes += 2;
+        length -= 2;
+    }
+    
+    std::string str;
+    for (size_t i = 0; i + 1 < length; i += 2) {
+        uint32_t unit = (big_endian ? (bytes[i] << 8) | bytes[i + 1] : (bytes[i + 1] << 8) | bytes[i]);
+        if (unit == 0) {
+            break;
+        }
+        
+        if (unit >= 0xD800 && unit < 0xDC00 && i + 3 < length) {
+            uint32_t low = (big_endian ? (bytes[i + 2] << 8) | bytes[i + 3] : (bytes[i + 3] << 8) | bytes[i + 2]);
+            if (low >= 0xDC00 && low < 0xE000) {
+                unit = 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00);
+                i += 2;
+            }
+        }
+        __append_utf8(str, unit);
+    }
+    return str;
+}
+
+static void __set_field(std::string &field, const std::string &value)
+{
+    // the first tag to have it wins
+    if (field.empty()) {
+        field = djpi::Util::trim(value.substr(0, MAX_FIELD_LENGTH));
+    }
+}
+
+#pragma mark - ID3
+
+static std::string __decode_id3_text(const unsigned char *bytes, size_t length)
+{
+    if (length < 1) {
+        return std::string();
+    }
+    
+    switch (bytes[0]) {
+        case 1:
+            return __decode_utf16(bytes + 1, length - 1, false);
+        case 2:
+            return __decode_utf16(bytes + 1, length - 1, true);
+        case 3:
+            return std::string((const char *) bytes + 1, strnlen((const char *) bytes + 1, length - 1));
+        default:
+            return __decode_latin1(bytes + 1, length - 1);
+    }
+}
+
+static void __parse_id3v2(const unsigned char *tag, size_t length, djpi::TrackInfo &info)
+{
+    // frames past the end of what was read (usually behind cover art) are skipped
+    if (length < 10 || memcmp(tag, "ID3", 3) != 0) {
+        return;
+    }
+    
+    unsigned int version = tag[3];
+    unsigned int flags = tag[5];
+    if (version < 2 || version > 4 || (flags & 0x80)) {
+        // unsynchronised tags would need undoing first, nothing writes those any more
+        return;
+    }
+    
+    size_t end = std::min(length, (size_t) __read_syncsafe32(tag + 6) + 10);
+    size_t position = 10;
+    if ((flags & 0x40) && version >= 3 && position + 4 <= end) {
+        // the extended header
+        position += (version == 3 ? __read_be32(tag + position) + 4 : __read_syncsafe32(tag + position));
+    }
+    
+    size_t id_length = (version == 2 ? 3 : 4);
+    size_t header_length = (version == 2 ? 6 : 10);
+    std::string duration;
+    while (position + header_length <= end && tag[position] != 0) {
+        const unsigned char *frame = tag + position;
+        size_t size = 0;
+        unsigned int frame_flags = 0;
+        if (version == 2) {
+            size = ((size_t) frame[3] << 16) | (frame[4] << 8) | frame[5];
+        } else {
+            size = (version == 4 ? __read_syncsafe32(frame + 4) : __read_be32(frame + 4));
+            frame_flags = frame[9];
+        }
+        position += header_length;
+        if (size > end - position) {
+            break;
+        }
+        
+        const unsigned char *data = tag + position;
+        position += size;
+        
+        // compressed or encrypted frames aren't worth the trouble
+        if (version == 3 && (frame_flags & 0xC0)) {
+            continue;
+        } else if (version == 4 && (frame_flags & 0x0E)) {
+            continue;
+        } else if (version == 4 && (frame_flags & 0x01) && size >= 4) {
+            data += 4; // data length indicator
+            size -= 4;
+        }
+        
+        std::string id((const char *) frame, id_length);
+        if (id == "TIT2" || id == "TT2") {
+            __set_field(info.title, __decode_id3_text(data, size));
+        } else if (id == "TPE1" || id == "TP1") {
+            __set_field(info.artist, __decode_id3_text(data, size));
+        } else if (id == "TALB" || id == "TAL") {
+            __set_field(info.album, __decode_id3_text(data, size));
+        } else if (id == "TLEN" || id == "TLE") {
+            duration = __decode_id3_text(data, size);
+        }
+    }
+    
+    // taggers guess at this, anything measured from the audio is preferred
+    if (info.duration_ms == 0 && !duration.empty()) {
+        info.duration_ms = (uint32_t) strtoul(duration.c_str(), NULL, 10);
+    }
+}
+
+static void __read_id3v1(TagFile &file, djpi::TrackInfo &info)
+{
+    // 128 bytes right at the end of the file, so it's only worth the read if nothing else had tags
+    const unsigned char *tag = (file.size >= 128 ? __get_bytes(file, file.size - 128, 128) : nullptr);
+    if (tag && memcmp(tag, "TAG", 3) == 0) {
+        __set_field(info.title, __decode_latin1(tag + 3, 30));
+        __set_field(info.artist, __decode_latin1(tag + 33, 30));
+        __set_field(info.album, __decode_latin1(tag + 63, 30));
+    }
+}
+
+#pragma mark - MPEG
+
+static uint32_t __read_mpeg_duration(TagFile &file, uint64_t audio_start)
+{
+    size_t length = (size_t) std::min((uint64_t) FRAME_READ_SIZE, file.size - std::min(file.size, audio_start));
+    const unsigned char *bytes = __get_bytes(file, audio_start, length);
+    if (!bytes) {
+        return 0;
+    }
+    
+    // the first frame that's followed by another like it, padding and junk can come first
+    djpi::MpegHeader header, next;
+    size_t position = 0;
+    bool found = false;
+    while (!found && position + 4 <= length) {
+        found = (header.parse(bytes + position) && position + header.size + 4 <= length &&
+                 next.parse(bytes + position + header.size) && header.is_same_stream(next));
+        if (!found) {
+            ++position;
+        }
+    }
+    if (!found) {
+        return 0;
+    }
+    
+    const unsigned char *frame = bytes + position;
+    const unsigned char *xing = frame + header.get_info_offset();
+    const unsigned char *vbri = frame + 4 + 32;
+    const unsigned char *frame_end = frame + header.size;
+    unsigned long long samples = 0;
+    if (xing + 8 <= frame_end && (memcmp(xing, "Xing", 4) == 0 || memcmp(xing, "Info", 4) == 0)) {
+        uint32_t flags = __read_be32(xing + 4);
+        const unsigned char *field = xing + 8;
+        uint32_t frames = 0;
+        if ((flags & 0x1) && field + 4 <= frame_end) {
+            frames = __read_be32(field);
+            field += 4;
+        }
+        field += ((flags & 0x2) ? 4 : 0) + ((flags & 0x4) ? 100 : 0) + ((flags & 0x8) ? 4 : 0);
+        samples = (unsigned long long) frames * header.samples;
+        
+        // LAME says how much silence the encoder added at each end
+        if (field + 24 <= frame_end && (memcmp(field, "LAME", 4) == 0 || memcmp(field, "Lavc", 4) == 0 || memcmp(field, "Lavf", 4) == 0)) {
+            unsigned int delay = (field[21] << 4) | (field[22] >> 4);
+            unsigned int padding = ((field[22] & 0x0F) << 8) | field[23];
+            if (samples > delay + padding) {
+                samples -= delay + padding;
+            }
+        }
+    } else if (vbri + 18 <= frame_end && memcmp(vbri, "VBRI", 4) == 0) {
+        samples = (unsigned long long) __read_be32(vbri + 14) * header.samples;
+    }
+    
+    if (samples > 0) {
+        return (uint32_t) (samples * 1000 / header.frequency);
+    }
+    
+    // no header to say otherwise, so it's taken to be constant bitrate
+    uint64_t audio_size = file.size - audio_start - position;
+    return (uint32_t) (audio_size * 8000 / header.bitrate);
+}
+
+static bool __read_mpeg(TagFile &file, djpi::TrackInfo &info)
+{
+    size_t tag_size = djpi::MpegHeader::get_id3v2_size(file.head.data(), file.head.size());
+    __parse_id3v2(file.head.data(), file.head.size(), info);
+    
+    uint32_t duration = __read_mpeg_duration(file, tag_size);
+    if (duration > 0) {
+        info.duration_ms = duration;
+    }
+    if (info.title.empty() && info.artist.empty()) {
+        __read_id3v1(file, info);
+    }
+    return !info.is_empty();
+}
+
+#pragma mark - Vorbis Comments
+
+static void __parse_vorbis_comments(const unsigned char *bytes, size_t length, djpi::TrackInfo &info)
+{
+    // little endian lengths throughout, a truncated block just yields what's there
+    if (length < 8) {
+        return;
+    }
+    
+    size_t position = 4 + (size_t) __read_le32(bytes); // vendor string
+    if (position + 4 > length) {
+        return;
+    }
+    uint32_t count = __read_le32(bytes + position);
+    position += 4;
+    
+    for (uint32_t i = 0; i < count && position + 4 <= length; ++i) {
+        size_t comment_length = __read_le32(bytes + position);
+        position += 4;
+        if (comment_length > length - position) {
+            break;
+        }
+        
+        std::string comment((const char *) bytes + position, comment_length);
+        position += comment_length;
+        size_t equals = comment.find('=');
+        if (equals == std::string::npos) {
+            continue;
+        }
+        
+        std::string key = comment.substr(0, equals);
+        std::transform(key.begin(), key.end(), key.begin(), ::toupper);
+        if (key == "TITLE") {
+            __set_field(info.title, comment.substr(equals + 1));
+        } else if (key == "ARTIST") {
+            __set_field(info.artist, comment.substr(equals + 1));
+        } else if (key == "ALBUM") {
+            __set_field(info.album, comment.substr(equals + 1));
+        }
+    }
+}
+
+#pragma mark - FLAC
+
+static bool __read_flac(TagFile &file, uint64_t start, djpi::TrackInfo &info)
+{
+    // metadata blocks follow the marker, STREAMINFO always first
+    uint64_t position = start + 4;
+    bool last = false;
+    for (int i = 0; i < MAX_CHUNK_COUNT && !last; ++i) {
+        const unsigned char *block_header = __get_bytes(file, position, 4);
+        if (!block_header) {
+            break;
+        }
+        
+        last = (block_header[0] & 0x80);
+        unsigned int type = block_header[0] & 0x7F;
+        size_t size = ((size_t) block_header[1] << 16) | (block_header[2] << 8) | block_header[3];
+        position += 4;
+        
+        if (type == 0 && size >= 18) {
+            const unsigned char *streaminfo = __get_bytes(file, position, 18);
+            if (streaminfo) {
+                unsigned int frequency = (streaminfo[10] << 12) | (streaminfo[11] << 4) | (streaminfo[12] >> 4);
+                unsigned long long samples = ((unsigned long long) (streaminfo[13] & 0x0F) << 32) | __read_be32(streaminfo + 14);
+                if (frequency > 0) {
+                    info.duration_ms = (uint32_t) (samples * 1000 / frequency);
+                }
+            }
+        } else if (type == 4) {
+            const unsigned char *comments = __get_bytes(file, position, std::min(size, (size_t) MAX_BLOCK_SIZE));
+            if (comments) {
+                __parse_vorbis_comments(comments, std::min(size, (size_t) MAX_BLOCK_SIZE), info);
+            }
+            break;
+        }
+        position += size;
+    }
+    return !info.is_empty();
+}
+
+#pragma mark - Ogg
+
+static bool __read_ogg(TagFile &file, djpi::TrackInfo &info)
+{
+    // gather the first two packets, the identification and comment headers, out of the pages in the head
+    std::vector<unsigned char> packets[2];
+    size_t packet = 0;
+    size_t position = 0;
+    const std::vector<unsigned char> &head = file.head;
+    while (packet < 2 && position + 27 <= head.size() && memcmp(&head[position], "OggS", 4) == 0) {
+        size_t segment_count = head[position + 26];
+        size_t data = position + 27 + segment_count;
+        if (data > head.size()) {
+            break;
+        }
+        
+        for (size_t i = 0; i < segment_count && packet < 2 && data < head.size(); ++i) {
+            size_t segment = head[position + 27 + i];
+            size_t available = std::min(segment, head.size() - data);
+            packets[packet].insert(packets[packet].end(), head.begin() + data, head.begin() + data + available);
+            data += segment;
+            if (segment < 255) {
+                ++packet;
+            }
+        }
+        position = data;
+    }
+    
+    const std::vector<unsigned char> &identification = packets[0];
+    if (identification.size() < 16 || memcmp(&identification[0], "\x01vorbis", 7) != 0) {
+        return false;
+    }
+    uint32_t frequency = __read_le32(&identification[12]);
+    
+    // a comment packet cut off by the end of the head still has the short fields at its start
+    const std::vector<unsigned char> &comments = packets[1];
+    if (comments.size() > 7 && memcmp(&comments[0], "\x03vorbis", 7) == 0) {
+        __parse_vorbis_comments(&comments[7], comments.size() - 7, info);
+    }
+    
+    // the granule position of the last page is the length in samples
+    size_t tail_length = (size_t) std::min(file.size, (uint64_t) TAIL_READ_SIZE);
+    const unsigned char *tail = __get_bytes(file, file.size - tail_length, tail_length);
+    for (size_t i = (tail_length >= 27 ? tail_length - 27 : 0) + 1; tail && frequency > 0 && i > 0; --i) {
+        const unsigned char *page = tail + i - 1;
+        if (memcmp(page, "OggS", 4) == 0) {
+            unsigned long long granule = ((unsigned long long) __read_le32(page + 10) << 32) | __read_le32(page + 6);
+            if (granule != (unsigned long long) -1) {
+                info.duration_ms = (uint32_t) (granule * 1000 / frequency);
+                break;
+            }
+        }
+    }
+    return !info.is_empty();
+}
+
+#pragma mark - RIFF and AIFF
+
+static bool __read_riff(TagFile &file, djpi::TrackInfo &info)
+{
+    // little endian chunks, the LIST chunk can come before or after the audio
+    uint64_t position = 12;
+    uint32_t byte_rate = 0;
+    for (int i = 0; i < MAX_CHUNK_COUNT && position + 8 <= file.size; ++i) {
+        const unsigned char *chunk_header = __get_bytes(file, position, 8);
+        if (!chunk_header) {
+            break;
+        }
+        
+        std::string id((const char *) chunk_header, 4);
+        uint64_t size = __read_le32(chunk_header + 4);
+        position += 8;
+        
+        if (id == "fmt " && size >= 12) {
+            const unsigned char *format = __get_bytes(file, position, 12);
+            byte_rate = (format ? __read_le32(format + 8) : 0);
+        } else if (id == "data" && byte_rate > 0) {
+            info.duration_ms = (uint32_t) (std::min(size, file.size - position) * 1000 / byte_rate);
+        } else if (id == "LIST" && size >= 4) {
+            size_t length = std::min((size_t) size, (size_t) MAX_BLOCK_SIZE);
+            const unsigned char *list = __get_bytes(file, position, length);
+            if (list && memcmp(list, "INFO", 4) == 0) {
+                for (size_t offset = 4; offset + 8 <= length;) {
+                    std::string field_id((const char *) list + offset, 4);
+                    size_t field_size = std::min((size_t) __read_le32(list + offset + 4), length - offset - 8);
+                    std::string value((const char *) list + offset + 8, strnlen((const char *) list + offset + 8, field_size));
+                    if (field_id == "INAM") {
+                        __set_field(info.title, value);
+                    } else if (field_id == "IART") {
+                        __set_field(info.artist, value);
+                    } else if (field_id == "IPRD") {
+                        __set_field(info.album, value);
+                    }
+                    offset += 8 + field_size + (field_size & 1);
+                }
+            }
+        } else if ((id == "id3 " || id == "ID3 ") && size >= 10) {
+            size_t length = std::min((size_t) size, (size_t) MAX_BLOCK_SIZE);
+            const unsigned char *tag = __get_bytes(file, position, length);
+            if (tag) {
+                __parse_id3v2(tag, length, info);
+            }
+        }
+        position += size + (size & 1);
+    }
+    return !info.is_empty();
+}
+
+static double __parse_extended(const unsigned char *bytes)
+{
+    // the 80-bit IEEE extended float AIFF keeps its sample rate in
+    int exponent = ((bytes[0] & 0x7F) << 8) | bytes[1];
+    unsigned long long mantissa = ((unsigned long long) __read_be32(bytes + 2) << 32) | __read_be32(bytes + 6);
+    if (exponent == 0 && mantissa == 0) {
+        return 0.0;
+    }
+    return ldexp((double) mantissa, exponent - 16383 - 63);
+}
+
+static bool __read_aiff(TagFile &file, djpi::TrackInfo &info)
+{
+    // big endian chunks, much like RIFF
+    uint64_t position = 12;
+    for (int i = 0; i < MAX_CHUNK_COUNT && position + 8 <= file.size; ++i) {
+        const unsigned char *chunk_header = __get_bytes(file, position, 8);
+        if (!chunk_header) {
+            break;
+        }
+        
+        std::string id((const char *) chunk_header, 4);
+        uint64_t size = __read_be32(chunk_header + 4);
+        position += 8;
+        
+        size_t length = std::min((size_t) size, (size_t) MAX_BLOCK_SIZE);
+        if (id == "COMM" && size >= 18) {
+            const unsigned char *common = __get_bytes(file, position, 18);
+            double frequency = (common ? __parse_extended(common + 8) : 0.0);
+            if (frequency > 0.0) {
+                info.duration_ms = (uint32_t) (__read_be32(common + 2) * 1000.0 / frequency);
+            }
+        } else if (id == "NAME" || id == "AUTH") {
+            const unsigned char *text = __get_bytes(file, position, length);
+            if (text) {
+                __set_field(id == "NAME" ? info.title : info.artist, std::string((const char *) text, strnlen((const char *) text, length)));
+            }
+        } else if ((id == "ID3 " || id == "id3 ") && size >= 10) {
+            const unsigned char *tag = __get_bytes(file, position, length);
+            if (tag) {
+                __parse_id3v2(tag, length, info);
+            }
+        }
+        position += size + (size & 1);
+    }
+    return !info.is_empty();
+}
+
+namespace djpi {
+
+bool TagReader::read(const std::string &filename, TrackInfo &info_out)
+{
+    return read_at(AT_FDCWD, filename.c_str(), info_out);
+}
+
+bool TagReader::read_at(int dir_fd, const char *name, TrackInfo &info_out)
+{
+    TagFile file;
+    file.fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC);
+    if (file.fd < 0) {
+        return false;
+    }
+    
+    struct stat s;
+    if (fstat(file.fd, &s) != 0) {
+        close(file.fd);
+        return false;
+    }
+    file.size = s.st_size;
+    
+    // everything is identified by its contents, a single read covers it for most files
+    __read_at(file.fd, 0, (size_t) std::min(file.size, (uint64_t) HEAD_READ_SIZE), file.head);
+    const std::vector<unsigned char> &head = file.head;
+    
+    bool found = false;
+    if (head.size() >= 12 && memcmp(&head[0], "RIFF", 4) == 0 && memcmp(&head[8], "WAVE", 4) == 0) {
+        found = __read_riff(file, info_out);
+    } else if (head.size() >= 12 && memcmp(&head[0], "FORM", 4) == 0 && (memcmp(&head[8], "AIFF", 4) == 0 || memcmp(&head[8], "AIFC", 4) == 0)) {
+        found = __read_aiff(file, info_out);
+    } else if (head.size() >= 4 && memcmp(&head[0], "OggS", 4) == 0) {
+        found = __read_ogg(file, info_out);
+    } else if (head.size() >= 4 && memcmp(&head[0], "fLaC", 4) == 0) {
+        found = __read_flac(file, 0, info_out);
+    } else if (head.size() >= 4) {
+        // a FLAC can have an ID3v2 tag in front too
+        size_t tag_size = MpegHeader::get_id3v2_size(head.data(), head.size());
+        const unsigned char *marker = __get_bytes(file, tag_size, 4);
+        if (tag_size > 0 && marker && memcmp(marker, "fLaC", 4) == 0) {
+            __parse_id3v2(head.data(), head.size(), info_out);
+            found = __read_flac(file, tag_size, info_out);
+        } else if (tag_size > 0 || (head[0] == 0xFF && (head[1] & 0xE0) == 0xE0)) {
+            found = __read_mpeg(file, info_out);
+        }
+    }
+    
+    close(file.fd);
+    return found;
+}
+
+std::string TagReader::describe(const TrackInfo &info, const char *name)
+{
+    std::string description;
+    if (!info.artist.empty() && !info.title.empty()) {
+        description = info.artist + " - " + info.title;
+    } else if (!info.title.empty()) {
+        description = info.title;
+    } else {
+        description = name;
+    }
+    
+    if (info.duration_ms > 0) {
+        unsigned int seconds = (info.duration_ms + 500) / 1000;
+        char duration[32];
+        snprintf(duration, sizeof(duration), " (%u:%02u)", seconds / 60, seconds % 60);
+        description += duration;
+    }
+    return description;
+}
+
+} // namespace djpi
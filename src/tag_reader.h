@@ -0,0 +1,26 @@
+/*
+ * tag_reader.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <string>
+#include "track_table.h"
+
+namespace djpi {
+
+// Reads titles, artists, albums and durations straight out of the headers of MP3 (ID3v1/v2,
+// Xing, VBRI and LAME), FLAC, Ogg Vorbis, WAV and AIFF files, without opening a sound. Most
+// files take a single read of their first few kilobytes. Safe to call from any thread.
+class TagReader {
+public:
+    static bool read(const std::string &filename, TrackInfo &info_out); // false if nothing was found
+    static bool read_at(int dir_fd, const char *name, TrackInfo &info_out); // name relative to the directory
+    
+    static std::string describe(const TrackInfo &info, const char *name); // "artist - title (m:ss)", or the name
+};
+
+} // namespace djpi
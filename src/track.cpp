@@ -6,25 +6,64 @@
  */
  
 #include "track.h"
+#include <utility>
 
 namespace djpi {
 
-Track::Track(std::string filename) :
-    _filename(filename),
-    _stream(nullptr)
+Track::Track(TrackHandle handle) :
+    _handle(handle),
+    _stream(nullptr),
+    _load_state(LoadState::UNLOADED),
+    _load_mode(LoadMode::STREAM),
+    _load_start_time(0.0)
 {}
 
+Track::Track(Track &&other) :
+    _handle(other._handle),
+    _stream(other._stream),
+    _pcm_stream(std::move(other._pcm_stream)),
+    _file_stats(std::move(other._file_stats)),
+    _load_state(other._load_state),
+    _load_mode(other._load_mode),
+    _load_start_time(other._load_start_time)
+{
+    other._stream = nullptr;
+    other._load_state = LoadState::UNLOADED;
+}
+
 Track::~Track()
 {
     release_stream();
 }
 
+Track& Track::operator=(Track &&other)
+{
+    if (this != &other) {
+        release_stream();
+        _handle = other._handle;
+        _stream = other._stream;
+        _pcm_stream = std::move(other._pcm_stream);
+        _file_stats = std::move(other._file_stats);
+        _load_state = other._load_state;
+        _load_mode = other._load_mode;
+        _load_start_time = other._load_start_time;
+        other._stream = nullptr;
+        other._load_state = LoadState::UNLOADED;
+    }
+    return *this;
+}
+
 void Track::release_stream()
 {
-    if (_stream) {
+    if (_pcm_stream) {
+        _pcm_stream->close();
+        _pcm_stream = nullptr;
+        _stream = nullptr;
+    } else if (_stream) {
         _stream->release();
         _stream = nullptr;
     }
+    _load_state = LoadState::UNLOADED;
 }
 
 } // namespace djpi
@@ -9,28 +9,45 @@
 
 #include <fmod/fmod.hpp>
 #include <memory>
-#include <string>
+#include "file_system.h"
+#include "load_policy.h"
+#include "pcm_stream.h"
+#include "track_table.h"
 
 namespace djpi {
 
 class Track {
 public:
-    Track(std::string filename = "");
+    enum class LoadState {
+        UNLOADED,
+        LOADING,
+        READY,
+        FAILED
+    };
+    
+    Track(TrackHandle handle = TrackTable::invalid_handle);
     Track(const Track&) = delete;
+    Track(Track &&other);
     ~Track();
     
+    Track& operator=(Track &&other);
+    
     // accessors
-    std::string get_filename() const { return _filename; }
+    TrackHandle get_handle() const { return _handle; }
+    LoadState get_load_state() const { return _load_state; }
     
     void release_stream();
 
 protected:
-    std::string _filename;
+    TrackHandle _handle;
     FMOD::Sound *_stream;
-
+    std::shared_ptr<PCMStream> _pcm_stream; // when decoding ahead, owns _stream
+    std::shared_ptr<FileStats> _file_stats;
+    LoadState _load_state;
+    LoadMode _load_mode;
+    double _load_start_time;
+    
     friend class AudioManager;
 };
 
-typedef std::shared_ptr<Track> TrackRef;
-    
 } // namespace djpi
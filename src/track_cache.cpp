@@ -0,0 +1,111 @@
+/*
+ * track_cache.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#include "track_cache.h"
+#include <utility>
+
+namespace djpi {
+
+TrackCache::TrackCache() :
+    _bytes(0),
+    _budget(0),
+    _hits(0),
+    _misses(0),
+    _evictions(0)
+{}
+
+void TrackCache::set_budget(size_t bytes)
+{
+    _budget = bytes;
+    _evict_to(_budget);
+}
+
+bool TrackCache::insert(Track &track, size_t bytes)
+{
+    if (bytes == 0 || bytes > _budget) {
+        return false;
+    }
+    
+    remove(track.get_handle());
+    _evict_to(_budget - bytes);
+    _entries.emplace_front(std::move(track), bytes);
+    _bytes += bytes;
+    return true;
+}
+
+bool TrackCache::take(TrackHandle handle, Track &track_out)
+{
+    if (_budget == 0) {
+        return false;
+    }
+    
+    for (auto itr = _entries.begin(); itr != _entries.end(); ++itr) {
+        if (itr->track.get_handle() == handle) {
+            track_out = std::move(itr->track);
+            _bytes -= itr->bytes;
+            _entries.erase(itr);
+            ++_hits;
+            return true;
+        }
+    }
+    
+    ++_misses;
+    return false;
+}
+
+void TrackCache::remove(TrackHandle handle)
+{
+    for (auto itr = _entries.begin(); itr != _entries.end(); ++itr) {
+        if (itr->track.get_handle() == handle) {
+            _bytes -= itr->bytes;
+            _entries.erase(itr);
+            return;
+        }
+    }
+}
+
+void TrackCache::clear()
+{
+    _entries.clear();
+    _bytes = 0;
+}
+
+std::vector<const Track *> TrackCache::get_tracks() const
+{
+    std::vector<const Track *> tracks;
+    tracks.reserve(_entries.size());
+    for (const Entry &entry : _entries) {
+        tracks.push_back(&entry.track);
+    }
+    return tracks;
+}
+
+TrackCacheStats TrackCache::get_stats() const
+{
+    TrackCacheStats stats;
+    stats.track_count = _entries.size();
+    stats.bytes = _bytes;
+    stats.budget = _budget;
+    stats.hits = _hits;
+    stats.misses = _misses;
+    stats.evictions = _evictions;
+    return stats;
+}
+
+#pragma mark - Internal
+
+void TrackCache::_evict_to(size_t bytes)
+{
+    // destroying the track releases its stream, they're all done opening so it won't block
+    while (_bytes > bytes && !_entries.empty()) {
+        _bytes -= _entries.back().bytes;
+        _entries.pop_back();
+        ++_evictions;
+    }
+}
+
+} // namespace djpi
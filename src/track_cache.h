@@ -0,0 +1,64 @@
+/*
+ * track_cache.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+ 
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <utility>
+#include <vector>
+#include "track.h"
+
+namespace djpi {
+
+struct TrackCacheStats {
+    size_t track_count;
+    size_t bytes;
+    size_t budget;
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+};
+
+// Recently played tracks, with their streams left open so going back to one starts it
+// straight away instead of opening the file all over again. The least recently used are
+// released once the cache grows past its budget. Only touched from the engine thread.
+class TrackCache {
+public:
+    TrackCache();
+    
+    void set_budget(size_t bytes); // 0 disables the cache
+    
+    // takes over the track's stream, or leaves the track alone if it can't be kept
+    bool insert(Track &track, size_t bytes);
+    bool take(TrackHandle handle, Track &track_out);
+    void remove(TrackHandle handle);
+    void clear();
+    
+    TrackCacheStats get_stats() const;
+    std::vector<const Track *> get_tracks() const; // most recently used first, valid until the cache changes
+
+private:
+    void _evict_to(size_t bytes);
+
+protected:
+    struct Entry {
+        Entry(Track &&track, size_t bytes) : track(std::move(track)), bytes(bytes) {}
+        
+        Track track;
+        size_t bytes;
+    };
+    
+    std::list<Entry> _entries; // most recently used first
+    size_t _bytes;
+    size_t _budget;
+    size_t _hits;
+    size_t _misses;
+    size_t _evictions;
+};
+
+} // namespace djpi
@@ -0,0 +1,350 @@
+/*
+ * track_table.cpp
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+
+#include "track_table.h"
+
+#include <algorithm>
+#include <cstring>
+
+#define CHUNK_SIZE          (64 * 1024) // offsets are (chunk << 16 | position)
+#define MIN_SLOT_COUNT      64
+#define EMPTY_SLOT          0xFFFFFFFF
+#define DELETED_SLOT        0xFFFFFFFE
+#define NO_STRING           0xFFFFFFFF
+#define MAX_INFO_LENGTH     1024 // has to fit in a chunk
+
+static size_t __hash_bytes(const char *bytes, size_t length, size_t seed = 2166136261u)
+{
+    // FNV-1a
+    size_t hash = seed;
+    for (size_t i = 0; i < length; ++i) {
+        hash ^= (unsigned char) bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static bool __equals(const char *stored, const char *str, size_t length)
+{
+    return strncmp(stored, str, length) == 0 && stored[length] == '\0';
+}
+
+namespace djpi {
+
+const TrackHandle TrackTable::invalid_handle;
+
+TrackTable::TrackTable() :
+    _track_count(0),
+    _used_track_slots(0)
+{}
+
+#pragma mark - Managing Tracks
+
+TrackHandle TrackTable::add(const std::string &filename)
+{
+    TrackHandle handle = find(filename);
+    if (handle != invalid_handle) {
+        return handle;
+    }
+
+    // keep the load factor under 3/4, counting tombstones left behind by removals
+    if ((_used_track_slots + 1) * 4 >= _track_slots.size() * 3) {
+        _grow_track_slots();
+    }
+
+    size_t slash = 0;
+    bool has_directory = _split_path(filename, slash);
+    const char *name = filename.c_str() + (has_directory ? slash + 1 : 0);
+    size_t name_length = filename.size() - (name - filename.c_str());
+
+    Record record;
+    record.directory = _intern_directory(filename.c_str(), (has_directory ? slash + 1 : 0));
+    record.name_offset = _store_string(name, name_length);
+    record.title_offset = NO_STRING;
+    record.artist_offset = NO_STRING;
+    record.album_offset = NO_STRING;
+    record.duration_ms = 0;
+    record.size_kb = 0;
+
+    handle = (TrackHandle) _records.size();
+    _records.push_back(record);
+
+    size_t slot = _find_slot(record.directory, name, name_length);
+    if (_track_slots[slot] == EMPTY_SLOT) {
+        ++_used_track_slots;
+    }
+    _track_slots[slot] = handle;
+    ++_track_count;
+
+    return handle;
+}
+
+TrackHandle TrackTable::find(const std::string &filename) const
+{
+    if (_track_slots.empty()) {
+        return invalid_handle;
+    }
+
+    size_t slash = 0;
+    bool has_directory = _split_path(filename, slash);
+    size_t directory_length = (has_directory ? slash + 1 : 0);
+    size_t directory_slot = _find_directory_slot(filename.c_str(), directory_length);
+    if (_directory_slots[directory_slot] == EMPTY_SLOT) {
+        return invalid_handle;
+    }
+
+    const char *name = filename.c_str() + directory_length;
+    size_t slot = _find_slot(_directory_slots[directory_slot], name, filename.size() - directory_length);
+    uint32_t handle = _track_slots[slot];
+    return (handle == EMPTY_SLOT || handle == DELETED_SLOT ? invalid_handle : handle);
+}
+
+void TrackTable::remove(TrackHandle handle)
+{
+    if (handle >= _records.size()) {
+        return;
+    }
+
+    const Record &record = _records[handle];
+    const char *name = _get_string(record.name_offset);
+    size_t slot = _find_slot(record.directory, name, strlen(name));
+    if (_track_slots[slot] == handle) {
+        // the strings stay in the arena until the table is cleared
+        _track_slots[slot] = DELETED_SLOT;
+        --_track_count;
+    }
+}
+
+void TrackTable::clear()
+{
+    std::vector<std::vector<char>>().swap(_chunks);
+    std::vector<uint32_t>().swap(_directories);
+    std::vector<Record>().swap(_records);
+    std::vector<uint32_t>().swap(_directory_slots);
+    std::vector<uint32_t>().swap(_track_slots);
+    _track_count = 0;
+    _used_track_slots = 0;
+}
+
+#pragma mark - Path Queries
+
+const char* TrackTable::get_name(TrackHandle handle) const
+{
+    return (handle < _records.size() ? _get_string(_records[handle].name_offset) : "");
+}
+
+const char* TrackTable::get_directory(TrackHandle handle) const
+{
+    // includes the trailing slash
+    return (handle < _records.size() ? _get_string(_directories[_records[handle].directory]) : "");
+}
+
+size_t TrackTable::get_filename(TrackHandle handle, char *buffer, size_t buffer_size) const
+{
+    const char *directory = get_directory(handle);
+    const char *name = get_name(handle);
+    size_t directory_length = strlen(directory);
+    size_t name_length = strlen(name);
+
+    if (buffer_size > 0) {
+        size_t copied = std::min(directory_length, buffer_size - 1);
+        memcpy(buffer, directory, copied);
+        size_t name_copied = std::min(name_length, buffer_size - 1 - copied);
+        memcpy(buffer + copied, name, name_copied);
+        buffer[copied + name_copied] = '\0';
+    }
+
+    return directory_length + name_length;
+}
+
+std::string TrackTable::get_filename(TrackHandle handle) const
+{
+    std::string filename = get_directory(handle);
+    filename += get_name(handle);
+    return filename;
+}
+
+#pragma mark - Track Info
+
+void TrackTable::set_info(TrackHandle handle, const TrackInfo &info)
+{
+    if (handle >= _records.size()) {
+        return;
+    }
+
+    uint32_t title_offset = _store_info_string(handle, info.title, &Record::title_offset);
+    uint32_t artist_offset = _store_info_string(handle, info.artist, &Record::artist_offset);
+    uint32_t album_offset = _store_info_string(handle, info.album, &Record::album_offset);
+
+    Record &record = _records[handle];
+    record.title_offset = title_offset;
+    record.artist_offset = artist_offset;
+    record.album_offset = album_offset;
+    record.duration_ms = info.duration_ms;
+    record.size_kb = (uint32_t) std::min((info.file_size + 1023) / 1024, (uint64_t) UINT32_MAX);
+}
+
+TrackInfo TrackTable::get_info(TrackHandle handle) const
+{
+    TrackInfo info;
+    if (handle < _records.size()) {
+        const Record &record = _records[handle];
+        info.title = (record.title_offset != NO_STRING ? _get_string(record.title_offset) : "");
+        info.artist = (record.artist_offset != NO_STRING ? _get_string(record.artist_offset) : "");
+        info.album = (record.album_offset != NO_STRING ? _get_string(record.album_offset) : "");
+        info.duration_ms = record.duration_ms;
+        info.file_size = (uint64_t) record.size_kb * 1024;
+    }
+    return info;
+}
+
+uint64_t TrackTable::get_file_size(TrackHandle handle) const
+{
+    return (handle < _records.size() ? (uint64_t) _records[handle].size_kb * 1024 : 0);
+}
+
+#pragma mark - Statistics
+
+size_t TrackTable::get_memory_usage() const
+{
+    size_t usage = _chunks.size() * CHUNK_SIZE;
+    usage += _directories.capacity() * sizeof(uint32_t);
+    usage += _records.capacity() * sizeof(Record);
+    usage += _directory_slots.capacity() * sizeof(uint32_t);
+    usage += _track_slots.capacity() * sizeof(uint32_t);
+    return usage;
+}
+
+#pragma mark - Internal
+
+uint32_t TrackTable::_intern_directory(const char *path, size_t length)
+{
+    if (_directory_slots.empty() || (_directories.size() + 1) * 4 >= _directory_slots.size() * 3) {
+        _grow_directory_slots();
+    }
+
+    // tracks mostly arrive a directory at a time, so this is usually a hit
+    size_t slot = _find_directory_slot(path, length);
+    if (_directory_slots[slot] == EMPTY_SLOT) {
+        _directory_slots[slot] = (uint32_t) _directories.size();
+        _directories.push_back(_store_string(path, length));
+    }
+    return _directory_slots[slot];
+}
+
+uint32_t TrackTable::_store_string(const char *str, size_t length)
+{
+    if (_chunks.empty() || _chunks.back().size() + length + 1 > CHUNK_SIZE) {
+        // chunks never reallocate, so pointers into them stay valid
+        _chunks.push_back(std::vector<char>());
+        _chunks.back().reserve(CHUNK_SIZE);
+    }
+
+    std::vector<char> &chunk = _chunks.back();
+    uint32_t offset = (uint32_t) (((_chunks.size() - 1) << 16) | chunk.size());
+    chunk.insert(chunk.end(), str, str + length);
+    chunk.push_back('\0');
+    return offset;
+}
+
+uint32_t TrackTable::_store_info_string(TrackHandle handle, const std::string &str, uint32_t Record::*field)
+{
+    if (str.empty()) {
+        return NO_STRING;
+    }
+
+    // tracks mostly arrive an album at a time, so the artist and album are usually the same as
+    // the track before's
+    if (handle > 0) {
+        uint32_t offset = _records[handle - 1].*field;
+        if (offset != NO_STRING && str == _get_string(offset)) {
+            return offset;
+        }
+    }
+    return _store_string(str.c_str(), std::min(str.size(), (size_t) MAX_INFO_LENGTH));
+}
+
+bool TrackTable::_split_path(const std::string &filename, size_t &slash_out) const
+{
+    slash_out = filename.find_last_of('/');
+    return slash_out != std::string::npos;
+}
+
+size_t TrackTable::_find_slot(uint32_t directory, const char *name, size_t name_length) const
+{
+    // returns the slot holding the track, or the empty slot where it would go
+    size_t mask = _track_slots.size() - 1;
+    size_t slot = __hash_bytes(name, name_length, 2166136261u ^ (directory * 2654435761u)) & mask;
+    size_t first_deleted = (size_t) -1;
+
+    while (true) {
+        uint32_t handle = _track_slots[slot];
+        if (handle == EMPTY_SLOT) {
+            return (first_deleted != (size_t) -1 ? first_deleted : slot);
+        } else if (handle == DELETED_SLOT) {
+            if (first_deleted == (size_t) -1) {
+                first_deleted = slot;
+            }
+        } else {
+            const Record &record = _records[handle];
+            if (record.directory == directory && __equals(_get_string(record.name_offset), name, name_length)) {
+                return slot;
+            }
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+size_t TrackTable::_find_directory_slot(const char *path, size_t length) const
+{
+    size_t mask = _directory_slots.size() - 1;
+    size_t slot = __hash_bytes(path, length) & mask;
+
+    while (true) {
+        uint32_t directory = _directory_slots[slot];
+        if (directory == EMPTY_SLOT || __equals(_get_string(_directories[directory]), path, length)) {
+            return slot;
+        }
+        slot = (slot + 1) & mask;
+    }
+}
+
+void TrackTable::_grow_track_slots()
+{
+    // rehashing also clears out tombstones, so only grow if live tracks need the room
+    size_t slot_count = std::max((size_t) MIN_SLOT_COUNT, _track_slots.size());
+    while ((_track_count + 1) * 2 >= slot_count) {
+        slot_count *= 2;
+    }
+
+    std::vector<uint32_t> old_slots(slot_count, EMPTY_SLOT);
+    old_slots.swap(_track_slots);
+    _used_track_slots = 0;
+
+    for (uint32_t handle : old_slots) {
+        if (handle != EMPTY_SLOT && handle != DELETED_SLOT) {
+            const Record &record = _records[handle];
+            const char *name = _get_string(record.name_offset);
+            _track_slots[_find_slot(record.directory, name, strlen(name))] = handle;
+            ++_used_track_slots;
+        }
+    }
+}
+
+void TrackTable::_grow_directory_slots()
+{
+    size_t slot_count = std::max((size_t) MIN_SLOT_COUNT, _directory_slots.size() * 2);
+    std::vector<uint32_t> slots(slot_count, EMPTY_SLOT);
+    _directory_slots.swap(slots);
+
+    for (uint32_t directory = 0; directory < _directories.size(); ++directory) {
+        const char *path = _get_string(_directories[directory]);
+        _directory_slots[_find_directory_slot(path, strlen(path))] = directory;
+    }
+}
+
+} // namespace djpi
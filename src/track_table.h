@@ -0,0 +1,94 @@
+/*
+ * track_table.h
+ *
+ * Author: Charles Magahern <charles@magahern.com>
+ * Date Created: 10/17/2026
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace djpi {
+
+typedef uint32_t TrackHandle;
+
+// What a track's tags say about it, and how big its file is, all of it optional.
+struct TrackInfo {
+    TrackInfo() : duration_ms(0), file_size(0) {}
+
+    bool is_empty() const { return title.empty() && artist.empty() && album.empty() && duration_ms == 0; } // no tags
+
+    std::string title;
+    std::string artist;
+    std::string album;
+    uint32_t duration_ms; // 0 if unknown
+    uint64_t file_size; // bytes when the library was scanned, 0 if unknown
+};
+
+// Stores every track path as an interned directory plus a leaf name, with the strings (and
+// any tags) packed into a shared arena. A track is just a handful of offsets, so a 100k track
+// library costs a few megabytes instead of a heap string (and hash node) per track.
+class TrackTable {
+public:
+    static const TrackHandle invalid_handle = (TrackHandle) -1;
+
+    TrackTable();
+
+    // managing tracks
+    TrackHandle add(const std::string &filename); // returns the existing handle for known paths
+    TrackHandle find(const std::string &filename) const;
+    void remove(TrackHandle handle); // the handle stays readable, it just can't be found anymore
+    void clear();
+    size_t size() const { return _track_count; }
+
+    // path queries, none of these allocate
+    const char* get_name(TrackHandle handle) const;
+    const char* get_directory(TrackHandle handle) const;
+    size_t get_filename(TrackHandle handle, char *buffer, size_t buffer_size) const; // returns the full length like snprintf
+    std::string get_filename(TrackHandle handle) const;
+
+    // track info, empty until it's set
+    void set_info(TrackHandle handle, const TrackInfo &info);
+    TrackInfo get_info(TrackHandle handle) const;
+    uint64_t get_file_size(TrackHandle handle) const; // rounded up to a KB, doesn't allocate
+
+    // statistics
+    size_t get_memory_usage() const;
+
+private:
+    struct Record {
+        uint32_t directory;
+        uint32_t name_offset;
+        uint32_t title_offset;
+        uint32_t artist_offset;
+        uint32_t album_offset;
+        uint32_t duration_ms;
+        uint32_t size_kb;
+    };
+
+    uint32_t _intern_directory(const char *path, size_t length);
+    uint32_t _store_string(const char *str, size_t length);
+    uint32_t _store_info_string(TrackHandle handle, const std::string &str, uint32_t Record::*field);
+    const char* _get_string(uint32_t offset) const { return &_chunks[offset >> 16][offset & 0xFFFF]; }
+    bool _split_path(const std::string &filename, size_t &slash_out) const;
+    size_t _find_slot(uint32_t directory, const char *name, size_t name_length) const;
+    size_t _find_directory_slot(const char *path, size_t length) const;
+    void _grow_track_slots();
+    void _grow_directory_slots();
+
+protected:
+    std::vector<std::vector<char>> _chunks;
+    std::vector<uint32_t> _directories; // path offset per directory id
+    std::vector<Record> _records;
+
+    // open addressing hash tables of directory ids and track handles
+    std::vector<uint32_t> _directory_slots;
+    std::vector<uint32_t> _track_slots;
+    size_t _track_count;
+    size_t _used_track_slots; // live tracks plus tombstones
+};
+
+} // namespace djpi
@@ -10,8 +10,8 @@
 #include <cstdio>
 #include <cstring>
 #include <dirent.h>
-#include <libgen.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
 
 namespace djpi {
@@ -66,28 +66,52 @@ std::string Util::filename_ext(std::string filename)
     return extension;
 }
 
-std::string Util::basename(std::string path)
+std::string Util::basename(const std::string &path)
 {
-    std::string base;
-    char *pathstr = strdup(path.c_str());
-    char *basestr = ::basename(pathstr);
-    if (basestr != NULL) {
-        base = basestr;
+    // same results as basename(3), without copying the path or pulling in libgen's macros
+    size_t end = path.find_last_not_of('/');
+    if (end == std::string::npos) {
+        return (path.empty() ? "." : "/");
     }
     
-    return basestr;
+    size_t start = path.find_last_of('/', end);
+    start = (start == std::string::npos ? 0 : start + 1);
+    return path.substr(start, end - start + 1);
 }
 
-std::string Util::dirname(std::string path)
+std::string Util::dirname(const std::string &path)
 {
-    std::string dir;
-    char *pathstr = strdup(path.c_str());
-    char *dirstr = ::dirname(pathstr);
-    if (pathstr != NULL) {
-        dir = dirstr;
+    size_t end = path.find_last_not_of('/');
+    if (end == std::string::npos) {
+        return (path.empty() ? "." : "/");
     }
     
-    return dir;
+    size_t slash = path.find_last_of('/', end);
+    if (slash == std::string::npos) {
+        return ".";
+    }
+    
+    size_t dir_end = path.find_last_not_of('/', slash);
+    return (dir_end == std::string::npos ? "/" : path.substr(0, dir_end + 1));
+}
+
+std::string Util::trim(const std::string &str)
+{
+    const char *whitespace = " \t\r\n";
+    size_t start = str.find_first_not_of(whitespace);
+    if (start == std::string::npos) {
+        return "";
+    }
+    
+    size_t end = str.find_last_not_of(whitespace);
+    return str.substr(start, end - start + 1);
+}
+
+double Util::current_time()
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
 }
 
 } // namespace djpi
@@ -17,8 +17,10 @@ public:
     static bool is_directory(std::string path);
     static std::vector<std::string> list_directory(std::string path);
     static std::string filename_ext(std::string filename);
-    static std::string basename(std::string path);
-    static std::string dirname(std::string path);
+    static std::string basename(const std::string &path);
+    static std::string dirname(const std::string &path);
+    static std::string trim(const std::string &str); // strips leading and trailing whitespace
+    static double current_time();
 };
 
 } // namespace djpi